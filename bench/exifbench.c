@@ -0,0 +1,608 @@
+// exifbench: benchmarks for the EXIF extension.
+//
+// Build it against a libjpeg that has jdexif.c added, for example
+//   cc -O2 -I<libjpeg> exifbench.c <libjpeg>/libjpeg.a -lpthread -o exifbench
+//
+// Usage:  exifbench [-t maxthreads] [-n passes] [-m header|buffer|lookup|lazy|thumb|suite] [-j] file.jpg ...
+//
+// The files are loaded into memory once.  Then for 1, 2, 4, ... maxthreads
+// threads every thread reads the EXIF data of all files "passes" times, each
+// thread with its own decompressor and its own exif context.  With -m header
+// (the default) jpeg_read_header is run on each file, with -m buffer the
+// decompressor is bypassed and exifParseBuffer is used.  The EXIF values
+// every thread reads are checked against a single threaded reference run, and
+// the throughput and the speedup over one thread are printed.
+//
+// -m lookup measures the accessors instead.  Each file is parsed once and
+// then the fields of a typical catalog schema are read "passes" times.  To
+// compare the tag index with the original linked list walk, build a second
+// copy with jdexif.c compiled with -DEXIF_LINEAR_LOOKUP.
+//
+// -m lazy compares eager and lazy (EXIF_OPTION_LAZY) parsing.  For each mode
+// every file is parsed with exifParseBuffer and then 1 tag, 10 tags or all
+// the tags of the file are read, and the time per file is printed.
+//
+// -m thumb compares decoding the main image of each file with decoding its
+// EXIF thumbnail through exifThumbnailSource_r.  Files without a thumbnail
+// have their main image decoded in both runs.
+//
+// -m suite runs the regression suite.  It times every parse of the files
+// with jpeg_read_header, exifParseBuffer and lazy exifParseBuffer and prints
+// the median, 99th percentile and mean latency along with the allocations
+// and the bytes copied per file.  Then it prints the time per call of each
+// accessor reading the catalog fields.  With -j the results are written as
+// JSON lines, so that the output of two builds can be compared by a script.
+// exifgen writes synthetic files to run it on.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "jpeglib.h"
+#include "jdexif.h"
+
+struct inputfile {
+	const char* name;
+	unsigned char* data;
+	unsigned long size;
+	uint64_t digest; // digest of the EXIF values from the reference run
+};
+
+static struct inputfile* files;
+static int numFiles;
+static int passes = 200;
+static boolean useParseBuffer = FALSE;
+static boolean benchLookups = FALSE;
+static boolean benchLazy = FALSE;
+static boolean benchThumb = FALSE;
+static boolean benchSuite = FALSE;
+static boolean jsonOutput = FALSE;
+static long allocations;
+
+// the fields read per image in the lookup benchmark
+static const uint16_t catalogASCII[] = {
+	TIFFMake, TIFFModel, TIFFSoftware, TIFFDateTime, TIFFArtist, TIFFCopyright,
+	EXIFDateTimeOriginal, EXIFDateTimeDigitized, EXIFLensModel, EXIFBodySerialNumber,
+	GPSLatitudeRef, GPSLongitudeRef, GPSDateStamp
+};
+static const uint16_t catalogUInt[] = {
+	TIFFOrientation, TIFFResolutionUnit, EXIFPhotographicSensitivity, EXIFMeteringMode,
+	EXIFFlash, EXIFPixelXDimension, EXIFPixelYDimension, EXIFWhiteBalance, EXIFColorSpace
+};
+static const uint16_t catalogRational[] = {
+	TIFFXResolution, TIFFYResolution, EXIFExposureTime, EXIFFNumber, EXIFFocalLength,
+	GPSLatitude, GPSLongitude, GPSAltitude
+};
+
+struct worker {
+	pthread_t thread;
+	long decoded;
+	long mismatches;
+};
+
+static double
+now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t
+mix(uint64_t h, const void* p, size_t n) {
+	const unsigned char* b = (const unsigned char*)p;
+	for (size_t i = 0; i < n; i++) h = (h ^ b[i]) * 0x100000001b3ULL;
+	return h;
+}
+
+// digest reads a handful of commonly used fields the way an application would
+// and folds them into a hash so the results of different threads can be compared.
+static uint64_t
+digest(j_exif_ptr ctx) {
+	uint64_t h = 0xcbf29ce484222325ULL;
+	char a[256];
+	uint32_t u[4];
+	double d[4];
+	int n;
+	memset(a, 0, sizeof(a));
+	n = exifASCIIData_r(ctx, EXIFDateTimeOriginal, a);
+	h = mix(h, &n, sizeof(n)); h = mix(h, a, sizeof(a));
+	n = exifASCIIData_r(ctx, TIFFMake, a);
+	h = mix(h, &n, sizeof(n)); h = mix(h, a, sizeof(a));
+	n = exifUIntData_r(ctx, TIFFOrientation, u);
+	h = mix(h, &n, sizeof(n)); if (n > 0) h = mix(h, u, n * sizeof(u[0]));
+	n = exifRationalData_r(ctx, EXIFExposureTime, d);
+	h = mix(h, &n, sizeof(n)); if (n > 0) h = mix(h, d, n * sizeof(d[0]));
+	n = exifRationalData_r(ctx, GPSLatitude, d);
+	h = mix(h, &n, sizeof(n)); if (n > 0) h = mix(h, d, (n > 4 ? 4 : n) * sizeof(d[0]));
+	return h;
+}
+
+// readHeader reads the EXIF data of one in-memory file and returns the digest.
+static uint64_t
+readHeader(j_decompress_ptr cinfo, j_exif_ptr ctx, struct inputfile* f) {
+	if (useParseBuffer) {
+		exifParseBuffer(ctx, f->data, f->size);
+		return digest(ctx);
+	}
+	tagmapFree_r(ctx);
+	jpeg_mem_src(cinfo, f->data, f->size);
+	jpeg_read_header(cinfo, TRUE);
+	uint64_t h = digest(ctx);
+	jpeg_abort_decompress(cinfo);
+	return h;
+}
+
+static void*
+workerMain(void* arg) {
+	struct worker* w = (struct worker*)arg;
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	j_exif_ptr ctx = exifCreate();
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_decompress(&cinfo);
+	exifAttach(&cinfo, ctx);
+	for (int p = 0; p < passes; p++) {
+		for (int i = 0; i < numFiles; i++) {
+			if (readHeader(&cinfo, ctx, &files[i]) != files[i].digest) w->mismatches++;
+			w->decoded++;
+		}
+	}
+	jpeg_destroy_decompress(&cinfo);
+	exifDestroy(ctx);
+	return NULL;
+}
+
+static unsigned char*
+loadFile(const char* name, unsigned long* size) {
+	FILE* fp = fopen(name, "rb");
+	if (fp == NULL) return NULL;
+	fseek(fp, 0, SEEK_END);
+	long n = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	unsigned char* buf = (unsigned char*)malloc(n > 0 ? n : 1);
+	if (buf != NULL && fread(buf, 1, n, fp) != (size_t)n) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(fp);
+	*size = (unsigned long)n;
+	return buf;
+}
+
+// benchLookup times reading the catalog fields from already parsed files.
+static int
+benchLookup() {
+	j_exif_ptr ctx = exifCreate();
+	static char a[65536];
+	static uint32_t u[65536];
+	static double d[65536];
+	long lookups = 0;
+	double elapsed = 0;
+	uint64_t sink = 0;
+
+	for (int i = 0; i < numFiles; i++) {
+		exifParseBuffer(ctx, files[i].data, files[i].size);
+		double start = now();
+		for (int p = 0; p < passes; p++) {
+			for (unsigned int k = 0; k < sizeof(catalogASCII) / sizeof(catalogASCII[0]); k++)
+				sink += exifASCIIData_r(ctx, catalogASCII[k], a);
+			for (unsigned int k = 0; k < sizeof(catalogUInt) / sizeof(catalogUInt[0]); k++)
+				sink += exifUIntData_r(ctx, catalogUInt[k], u);
+			for (unsigned int k = 0; k < sizeof(catalogRational) / sizeof(catalogRational[0]); k++)
+				sink += exifRationalData_r(ctx, catalogRational[k], d);
+		}
+		elapsed += now() - start;
+		lookups += (long)passes * (sizeof(catalogASCII) / sizeof(catalogASCII[0]) +
+			sizeof(catalogUInt) / sizeof(catalogUInt[0]) +
+			sizeof(catalogRational) / sizeof(catalogRational[0]));
+	}
+	exifDestroy(ctx);
+	printf("lookups  ns/lookup  (%llu)\n", (unsigned long long)sink);
+	printf("%7ld  %9.1f\n", lookups, elapsed * 1e9 / lookups);
+	return 0;
+}
+
+// readTags reads numTags of the catalog fields, or all the tags in the file
+// if numTags is negative.
+static uint64_t
+readTags(j_exif_ptr ctx, int numTags) {
+	static char a[65536];
+	static uint32_t u[65536];
+	static double d[65536];
+	static const uint16_t tenTags[] = {
+		TIFFOrientation, TIFFMake, TIFFModel, EXIFDateTimeOriginal, EXIFExposureTime,
+		EXIFFNumber, EXIFPhotographicSensitivity, EXIFFocalLength, GPSLatitude, GPSLongitude
+	};
+	uint32_t keys[4096];
+	uint64_t sink = 0;
+	int n;
+
+	if (numTags >= 0) {
+		for (int i = 0; i < numTags; i++) sink += exifTagInfo_r(ctx, tenTags[i], NULL, NULL);
+		return sink;
+	}
+	n = exifTagList_r(ctx, keys, 4096);
+	if (n > 4096) n = 4096;
+	for (int i = 0; i < n; i++) {
+		uint16_t type;
+		uint32_t count;
+		exifTagInfo_r(ctx, keys[i], &type, &count);
+		if (count > 65535) continue;
+		if (type == TIFF_TYPE_ASCII) sink += exifASCIIData_r(ctx, keys[i], a);
+		else if (type == TIFF_TYPE_SLONG) sink += exifIntData_r(ctx, keys[i], (int32_t*)u);
+		else if (type == TIFF_TYPE_RATIONAL || type == TIFF_TYPE_SRATIONAL)
+			sink += exifRationalData_r(ctx, keys[i], d);
+		else sink += exifUIntData_r(ctx, keys[i], u);
+	}
+	return sink;
+}
+
+static int
+compareKeys(const void* a, const void* b) {
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+// tagsDigest folds every tag of ctx, with its type, count and value bytes,
+// into a hash.  The tags are taken in key order, so the hash doesn't depend
+// on the order they were decoded in.
+static uint64_t
+tagsDigest(j_exif_ptr ctx) {
+	static const int typeSize[] = { 0,1,1,2,4,8,0,1,0,4,8 };
+	uint64_t h = 0xcbf29ce484222325ULL;
+	uint32_t keys[4096];
+	int n = exifTagList_r(ctx, keys, 4096);
+	if (n > 4096) n = 4096;
+	qsort(keys, n, sizeof(uint32_t), compareKeys);
+	for (int i = 0; i < n; i++) {
+		uint16_t type = 0;
+		const uint8_t* data = NULL;
+		int count = exifRawData_r(ctx, keys[i], &type, &data);
+		h = mix(h, &keys[i], sizeof(keys[i]));
+		h = mix(h, &type, sizeof(type));
+		h = mix(h, &count, sizeof(count));
+		if (count > 0 && type < sizeof(typeSize) / sizeof(typeSize[0]))
+			h = mix(h, data, (size_t)count * typeSize[type]);
+	}
+	return h;
+}
+
+// benchLazyParse compares eager and lazy parsing for light and full queries.
+// First it checks that both give the same tags for every file, looking a
+// few tags up in lazy mode before listing them all.
+static int
+benchLazyParse() {
+	static const int workloads[] = { 1, 10, -1 };
+	j_exif_ptr ctx = exifCreate();
+	uint64_t sink = 0;
+	long mismatches = 0;
+
+	for (int i = 0; i < numFiles; i++) {
+		exifSetOptions(ctx, 0);
+		exifParseBuffer(ctx, files[i].data, files[i].size);
+		uint64_t eager = tagsDigest(ctx);
+		exifSetOptions(ctx, EXIF_OPTION_LAZY);
+		exifParseBuffer(ctx, files[i].data, files[i].size);
+		sink += readTags(ctx, 10);
+		if (tagsDigest(ctx) != eager) mismatches++;
+	}
+
+	printf("tags  eager ns/file  lazy ns/file  speedup\n");
+	for (int w = 0; w < 3; w++) {
+		double ns[2];
+		for (int lazy = 0; lazy < 2; lazy++) {
+			exifSetOptions(ctx, lazy ? EXIF_OPTION_LAZY : 0);
+			double start = now();
+			for (int p = 0; p < passes; p++) {
+				for (int i = 0; i < numFiles; i++) {
+					exifParseBuffer(ctx, files[i].data, files[i].size);
+					sink += readTags(ctx, workloads[w]);
+				}
+			}
+			ns[lazy] = (now() - start) * 1e9 / ((double)passes * numFiles);
+		}
+		if (workloads[w] < 0) printf(" all");
+		else printf("%4d", workloads[w]);
+		printf("  %13.1f  %12.1f  %7.2f\n", ns[0], ns[1], ns[0] / ns[1]);
+	}
+	printf("mismatches %ld\n", mismatches);
+	exifDestroy(ctx);
+	return mismatches != 0 || sink == 0;  // sink keeps the reads from being optimized away
+}
+
+// decodeImage decodes the image cinfo reads and returns the number of pixels.
+static long
+decodeImage(j_decompress_ptr cinfo) {
+	JSAMPARRAY row;
+	jpeg_read_header(cinfo, TRUE);
+	jpeg_start_decompress(cinfo);
+	row = (*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_IMAGE,
+		cinfo->output_width * cinfo->output_components, 1);
+	while (cinfo->output_scanline < cinfo->output_height) jpeg_read_scanlines(cinfo, row, 1);
+	jpeg_finish_decompress(cinfo);
+	return (long)cinfo->output_width * cinfo->output_height;
+}
+
+// benchThumbnails compares a full decode with a thumbnail first decode.
+static int
+benchThumbnails() {
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	j_exif_ptr ctx = exifCreate();
+	long pixels[2] = { 0, 0 };
+	double ms[2];
+	int withThumbnail = 0;
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_decompress(&cinfo);
+	for (int thumb = 0; thumb < 2; thumb++) {
+		double start = now();
+		for (int p = 0; p < passes; p++) {
+			for (int i = 0; i < numFiles; i++) {
+				// the decompressor is not attached to ctx, so reading the
+				// thumbnail leaves the EXIF data it is in alone
+				exifParseBuffer(ctx, files[i].data, files[i].size);
+				if (thumb && exifThumbnailSource_r(ctx, &cinfo)) withThumbnail++;
+				else jpeg_mem_src(&cinfo, files[i].data, files[i].size);
+				pixels[thumb] += decodeImage(&cinfo);
+			}
+		}
+		ms[thumb] = (now() - start) * 1e3 / ((double)passes * numFiles);
+	}
+	jpeg_destroy_decompress(&cinfo);
+	exifDestroy(ctx);
+
+	printf("%d of %d files have a thumbnail\n", withThumbnail / passes, numFiles);
+	printf("decode     ms/file  pixels/file\n");
+	printf("full      %9.3f  %11.0f\n", ms[0], (double)pixels[0] / ((double)passes * numFiles));
+	printf("thumbnail %9.3f  %11.0f\n", ms[1], (double)pixels[1] / ((double)passes * numFiles));
+	printf("speedup   %9.2f\n", ms[0] / ms[1]);
+	return 0;
+}
+
+// countingAlloc is the allocator of the extension in the suite.
+static void*
+countingAlloc(size_t size) {
+	__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+	return malloc(size);
+}
+
+static int
+compareDoubles(const void* a, const void* b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+// catalog is the destination of the catalog fields read with exifExtract_r.
+#define NUM_ASCII (sizeof(catalogASCII) / sizeof(catalogASCII[0]))
+#define NUM_UINT (sizeof(catalogUInt) / sizeof(catalogUInt[0]))
+#define NUM_RATIONAL (sizeof(catalogRational) / sizeof(catalogRational[0]))
+struct catalog {
+	char ascii[NUM_ASCII][64];
+	uint32_t uints[NUM_UINT][4];
+	double rationals[NUM_RATIONAL][4];
+};
+
+static j_exif_fields
+catalogFields() {
+	struct exif_field fields[NUM_ASCII + NUM_UINT + NUM_RATIONAL];
+	int n = 0;
+	for (unsigned int k = 0; k < NUM_ASCII; k++, n++) {
+		struct exif_field f = { catalogASCII[k], TIFF_TYPE_ASCII, 64,
+			offsetof(struct catalog, ascii) + k * 64, EXIF_NO_COUNT };
+		fields[n] = f;
+	}
+	for (unsigned int k = 0; k < NUM_UINT; k++, n++) {
+		struct exif_field f = { catalogUInt[k], TIFF_TYPE_SHORT, 4,
+			offsetof(struct catalog, uints) + k * 4 * sizeof(uint32_t), EXIF_NO_COUNT };
+		fields[n] = f;
+	}
+	for (unsigned int k = 0; k < NUM_RATIONAL; k++, n++) {
+		struct exif_field f = { catalogRational[k], TIFF_TYPE_RATIONAL, 4,
+			offsetof(struct catalog, rationals) + k * 4 * sizeof(double), EXIF_NO_COUNT };
+		fields[n] = f;
+	}
+	return exifFieldsCreate(fields, n);
+}
+
+// suiteParse times every parse of the files in one mode and prints the
+// latency percentiles, the allocations and the bytes copied per file.
+static void
+suiteParse(const char* mode) {
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	j_exif_ptr ctx = exifCreate();
+	long numSamples = (long)passes * numFiles, k = 0;
+	double* samples = (double*)malloc(numSamples * sizeof(double));
+	double total = 0;
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_decompress(&cinfo);
+	exifAttach(&cinfo, ctx);
+	exifSetOptions(ctx, strcmp(mode, "lazy") == 0 ? EXIF_OPTION_LAZY : 0);
+	long allocationsBefore = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+	uint64_t copiedBefore = exifBytesCopied_r(ctx);
+	for (int p = 0; p < passes; p++) {
+		for (int i = 0; i < numFiles; i++) {
+			double start = now();
+			if (strcmp(mode, "header") == 0) {
+				tagmapFree_r(ctx);
+				jpeg_mem_src(&cinfo, files[i].data, files[i].size);
+				jpeg_read_header(&cinfo, TRUE);
+				jpeg_abort_decompress(&cinfo);
+			} else {
+				exifParseBuffer(ctx, files[i].data, files[i].size);
+			}
+			samples[k] = now() - start;
+			total += samples[k++];
+		}
+	}
+	double allocs = (double)(__atomic_load_n(&allocations, __ATOMIC_RELAXED) - allocationsBefore) / numSamples;
+	double copied = (double)(exifBytesCopied_r(ctx) - copiedBefore) / numSamples;
+	jpeg_destroy_decompress(&cinfo);
+	exifDestroy(ctx);
+
+	qsort(samples, numSamples, sizeof(double), compareDoubles);
+	double p50 = samples[numSamples / 2] * 1e9;
+	double p99 = samples[numSamples * 99 / 100] * 1e9;
+	double mean = total * 1e9 / numSamples;
+	if (jsonOutput) {
+		printf("{\"bench\":\"parse\",\"mode\":\"%s\",\"files\":%d,\"passes\":%d,\"p50_ns\":%.1f,"
+			"\"p99_ns\":%.1f,\"mean_ns\":%.1f,\"allocs_per_file\":%.3f,\"bytes_copied_per_file\":%.1f}\n",
+			mode, numFiles, passes, p50, p99, mean, allocs, copied);
+	} else {
+		printf("%-6s  %8.1f  %8.1f  %8.1f  %11.3f  %12.1f\n", mode, p50, p99, mean, allocs, copied);
+	}
+	free(samples);
+}
+
+// suiteAccessor prints the time per call of an accessor.
+static void
+suiteAccessor(const char* accessor, double seconds, long calls) {
+	if (jsonOutput) {
+		printf("{\"bench\":\"accessor\",\"accessor\":\"%s\",\"calls\":%ld,\"ns_per_call\":%.1f}\n",
+			accessor, calls, seconds * 1e9 / calls);
+	} else {
+		printf("%-20s  %11.1f\n", accessor, seconds * 1e9 / calls);
+	}
+}
+
+// benchRegression runs the regression suite: parse latency and then the
+// lookup cost of every accessor.
+static int
+benchRegression() {
+	static char a[65536];
+	static uint32_t u[65536];
+	static double d[65536];
+	static struct catalog dst;
+	static const char* modes[] = { "header", "buffer", "lazy" };
+	j_exif_ptr ctx = exifCreate();
+	j_exif_fields set = catalogFields();
+	double elapsed[5] = { 0, 0, 0, 0, 0 };
+	uint64_t sink = 0;
+
+	if (!jsonOutput) printf("parse     p50 ns    p99 ns   mean ns  allocs/file  copied bytes\n");
+	for (int m = 0; m < 3; m++) suiteParse(modes[m]);
+
+	for (int i = 0; i < numFiles; i++) {
+		exifParseBuffer(ctx, files[i].data, files[i].size);
+		double start = now();
+		for (int p = 0; p < passes; p++)
+			for (unsigned int k = 0; k < NUM_ASCII; k++) sink += exifASCIIData_r(ctx, catalogASCII[k], a);
+		double t1 = now();
+		for (int p = 0; p < passes; p++)
+			for (unsigned int k = 0; k < NUM_UINT; k++) sink += exifUIntData_r(ctx, catalogUInt[k], u);
+		double t2 = now();
+		for (int p = 0; p < passes; p++)
+			for (unsigned int k = 0; k < NUM_RATIONAL; k++) sink += exifRationalData_r(ctx, catalogRational[k], d);
+		double t3 = now();
+		for (int p = 0; p < passes; p++)
+			for (unsigned int k = 0; k < NUM_UINT; k++) sink += exifTagInfo_r(ctx, catalogUInt[k], NULL, NULL);
+		double t4 = now();
+		for (int p = 0; p < passes; p++) sink += exifExtract_r(ctx, set, &dst);
+		double t5 = now();
+		elapsed[0] += t1 - start;
+		elapsed[1] += t2 - t1;
+		elapsed[2] += t3 - t2;
+		elapsed[3] += t4 - t3;
+		elapsed[4] += t5 - t4;
+	}
+	long calls = (long)passes * numFiles;
+	if (!jsonOutput) printf("accessor              ns/call\n");
+	suiteAccessor("exifASCIIData_r", elapsed[0], calls * NUM_ASCII);
+	suiteAccessor("exifUIntData_r", elapsed[1], calls * NUM_UINT);
+	suiteAccessor("exifRationalData_r", elapsed[2], calls * NUM_RATIONAL);
+	suiteAccessor("exifTagInfo_r", elapsed[3], calls * NUM_UINT);
+	// per field, so it compares with the single accessors
+	suiteAccessor("exifExtract_r", elapsed[4], calls * (NUM_ASCII + NUM_UINT + NUM_RATIONAL));
+	exifFieldsDestroy(set);
+	exifDestroy(ctx);
+	return sink == 0;  // keeps the reads from being optimized away
+}
+
+static int
+benchThreads(int maxThreads) {
+	double base = 0;
+	int failed = 0;
+	printf("threads  files/s      speedup  mismatches\n");
+	for (int t = 1; ; t *= 2) {
+		if (t > maxThreads) t = maxThreads;
+		struct worker* w = (struct worker*)calloc(t, sizeof(struct worker));
+		double start = now();
+		for (int i = 0; i < t; i++) pthread_create(&w[i].thread, NULL, workerMain, &w[i]);
+		long decoded = 0, mismatches = 0;
+		for (int i = 0; i < t; i++) {
+			pthread_join(w[i].thread, NULL);
+			decoded += w[i].decoded;
+			mismatches += w[i].mismatches;
+		}
+		double rate = decoded / (now() - start);
+		if (t == 1) base = rate;
+		printf("%7d  %11.0f  %7.2f  %ld\n", t, rate, rate / base, mismatches);
+		if (mismatches != 0) failed = 1;
+		free(w);
+		if (t == maxThreads) break;
+	}
+	return failed;
+}
+
+int
+main(int argc, char** argv) {
+	int maxThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+	while ((opt = getopt(argc, argv, "t:n:m:j")) != -1) {
+		if (opt == 't') maxThreads = atoi(optarg);
+		else if (opt == 'n') passes = atoi(optarg);
+		else if (opt == 'm' && strcmp(optarg, "header") == 0) useParseBuffer = FALSE;
+		else if (opt == 'm' && strcmp(optarg, "buffer") == 0) useParseBuffer = TRUE;
+		else if (opt == 'm' && strcmp(optarg, "lookup") == 0) benchLookups = TRUE;
+		else if (opt == 'm' && strcmp(optarg, "lazy") == 0) benchLazy = TRUE;
+		else if (opt == 'm' && strcmp(optarg, "thumb") == 0) benchThumb = TRUE;
+		else if (opt == 'm' && strcmp(optarg, "suite") == 0) benchSuite = TRUE;
+		else if (opt == 'j') jsonOutput = TRUE;
+		else {
+			fprintf(stderr, "usage: %s [-t maxthreads] [-n passes] [-m header|buffer|lookup|lazy|thumb|suite] [-j] file.jpg ...\n", argv[0]);
+			return 2;
+		}
+	}
+	if (optind >= argc || maxThreads < 1 || passes < 1) {
+		fprintf(stderr, "usage: %s [-t maxthreads] [-n passes] [-m header|buffer|lookup|lazy|thumb|suite] [-j] file.jpg ...\n", argv[0]);
+		return 2;
+	}
+
+	// the allocator has to be in place before the first context is created
+	if (benchSuite) exifSetAllocator(countingAlloc, free);
+
+	numFiles = argc - optind;
+	files = (struct inputfile*)calloc(numFiles, sizeof(struct inputfile));
+	for (int i = 0; i < numFiles; i++) {
+		files[i].name = argv[optind + i];
+		files[i].data = loadFile(files[i].name, &files[i].size);
+		if (files[i].data == NULL) {
+			fprintf(stderr, "can't read %s\n", files[i].name);
+			return 1;
+		}
+	}
+
+	// single threaded reference run
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	j_exif_ptr ctx = exifCreate();
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_decompress(&cinfo);
+	exifAttach(&cinfo, ctx);
+	for (int i = 0; i < numFiles; i++) files[i].digest = readHeader(&cinfo, ctx, &files[i]);
+	jpeg_destroy_decompress(&cinfo);
+	exifDestroy(ctx);
+
+	if (benchLookups) return benchLookup();
+	if (benchLazy) return benchLazyParse();
+	if (benchThumb) return benchThumbnails();
+	if (benchSuite) return benchRegression();
+	return benchThreads(maxThreads);
+}
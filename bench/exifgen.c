@@ -0,0 +1,384 @@
+// exifgen: writes synthetic JPEG files with EXIF data to run the benchmarks on.
+//
+// Build it against libjpeg, with jdexif.h in the include path, for example
+//   cc -O2 -I<libjpeg> exifgen.c <libjpeg>/libjpeg.a -o exifgen
+//
+// Usage:  exifgen [-n files] [-t tags] [-v valuesize] [-b le|be|mixed] [-g]
+//                 [-T thumbsize] [-M makernotesize] [-W width] [-s seed] [-r] outdir
+//
+// Every file gets the tags a camera typically writes to IFD0 and the Exif IFD
+// (19 of them).  -t raises the number of tags in those two IFDs by adding
+// private tags of various types to the Exif IFD.  -v sets the length of the
+// text values, such as Make, Model and LensModel.  -b sets the byte order,
+// mixed alternates between the two.  -g adds a GPS IFD, -T a thumbnail of
+// thumbsize by 3/4 thumbsize pixels in IFD1 and -M a MakerNote of the given
+// size.  The main image is width by 3/4 width pixels, 1920 by 1440 unless -W
+// is given, and has to be larger than the thumbnail.  The values differ from
+// file to file and follow from the seed, so the same options always give the
+// same files.  With -r the APP1 payloads are written to .app1 files instead of
+// JPEG files.  The whole APP1 segment has to fit in 65533 bytes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "jpeglib.h"
+#include "jdexif.h"  // for the tag names
+
+#define MAX_TAGS 4096
+#define MAX_APP1 65533
+
+// an entry of an IFD whose value is kept in pool
+struct tiffentry {
+	uint16_t tag;
+	uint16_t type;
+	uint32_t count;
+	uint32_t size;   // bytes of the value
+	uint32_t value;  // offset of the value in pool
+};
+
+struct ifd {
+	struct tiffentry entries[MAX_TAGS];
+	int numEntries;
+};
+
+static struct ifd ifd0, exifIFD, gpsIFD, ifd1;
+static uint8_t pool[1 << 20];
+static uint32_t poolUsed;
+static boolean bigEndian;
+static uint32_t randomState;
+
+static uint32_t
+nextRandom() {
+	// xorshift32
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return randomState;
+}
+
+static void
+put16(uint8_t* p, uint32_t v) {
+	if (bigEndian) { p[0] = (uint8_t)(v >> 8); p[1] = (uint8_t)v; }
+	else { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+}
+
+static void
+put32(uint8_t* p, uint32_t v) {
+	if (bigEndian) { put16(p, v >> 16); put16(p + 2, v); }
+	else { put16(p, v); put16(p + 2, v >> 16); }
+}
+
+// addEntry adds an entry with room for its value in pool and returns the
+// value to be filled in.
+static uint8_t*
+addEntry(struct ifd* d, uint16_t tag, uint16_t type, uint32_t count, uint32_t size) {
+	struct tiffentry* e = &d->entries[d->numEntries++];
+	e->tag = tag;
+	e->type = type;
+	e->count = count;
+	e->size = size;
+	e->value = poolUsed;
+	poolUsed += size;
+	memset(pool + e->value, 0, size);
+	return pool + e->value;
+}
+
+// addText adds an ASCII value of length letters, which starts with prefix.
+static void
+addText(struct ifd* d, uint16_t tag, const char* prefix, uint32_t length) {
+	char* p = (char*)addEntry(d, tag, TIFF_TYPE_ASCII, length + 1, length + 1);
+	uint32_t prefixLength = (uint32_t)strlen(prefix);
+	for (uint32_t i = 0; i < length; i++)
+		p[i] = i < prefixLength ? prefix[i] : (char)('a' + nextRandom() % 26);
+}
+
+static void
+addDate(struct ifd* d, uint16_t tag) {
+	char* p = (char*)addEntry(d, tag, TIFF_TYPE_ASCII, 20, 20);
+	snprintf(p, 20, "20%02u:%02u:%02u %02u:%02u:%02u", nextRandom() % 30, 1 + nextRandom() % 12,
+		1 + nextRandom() % 28, nextRandom() % 24, nextRandom() % 60, nextRandom() % 60);
+}
+
+static void
+addShort(struct ifd* d, uint16_t tag, uint32_t v) {
+	put16(addEntry(d, tag, TIFF_TYPE_SHORT, 1, 2), v);
+}
+
+static void
+addLong(struct ifd* d, uint16_t tag, uint32_t v) {
+	put32(addEntry(d, tag, TIFF_TYPE_LONG, 1, 4), v);
+}
+
+static void
+addBytes(struct ifd* d, uint16_t tag, uint16_t type, uint32_t count) {
+	uint8_t* p = addEntry(d, tag, type, count, count);
+	for (uint32_t i = 0; i < count; i++) p[i] = (uint8_t)nextRandom();
+}
+
+// addRationals adds count RATIONAL or SRATIONAL values from numerator and
+// denominator pairs.
+static void
+addRationals(struct ifd* d, uint16_t tag, uint16_t type, const uint32_t* pairs, uint32_t count) {
+	uint8_t* p = addEntry(d, tag, type, count, 8 * count);
+	for (uint32_t i = 0; i < 2 * count; i++) put32(p + 4 * i, pairs[i]);
+}
+
+static void
+addRational(struct ifd* d, uint16_t tag, uint32_t numerator, uint32_t denominator) {
+	uint32_t pair[2] = { numerator, denominator };
+	addRationals(d, tag, TIFF_TYPE_RATIONAL, pair, 1);
+}
+
+// setLong changes the LONG value of tag, for the offsets that are only known
+// once the IFDs are laid out.
+static void
+setLong(struct ifd* d, uint16_t tag, uint32_t v) {
+	for (int i = 0; i < d->numEntries; i++)
+		if (d->entries[i].tag == tag) put32(pool + d->entries[i].value, v);
+}
+
+static int
+compareEntries(const void* a, const void* b) {
+	return (int)((const struct tiffentry*)a)->tag - (int)((const struct tiffentry*)b)->tag;
+}
+
+// ifdSize returns the bytes an IFD takes with the values that don't fit in
+// its entries.  Those values start on an even offset.
+static uint32_t
+ifdSize(const struct ifd* d) {
+	uint32_t size = 2 + 12 * d->numEntries + 4;
+	for (int i = 0; i < d->numEntries; i++)
+		if (d->entries[i].size > 4) size += (d->entries[i].size + 1) & ~1u;
+	return size;
+}
+
+// writeIFD writes d at offset pos of the TIFF data in out, with its entries
+// in tag order and its values after them.
+static void
+writeIFD(uint8_t* out, uint32_t pos, struct ifd* d, uint32_t next) {
+	uint32_t valuePos = pos + 2 + 12 * d->numEntries + 4;
+	qsort(d->entries, d->numEntries, sizeof(struct tiffentry), compareEntries);
+	put16(out + pos, d->numEntries);
+	for (int i = 0; i < d->numEntries; i++) {
+		struct tiffentry* e = &d->entries[i];
+		uint8_t* p = out + pos + 2 + 12 * i;
+		put16(p, e->tag);
+		put16(p + 2, e->type);
+		put32(p + 4, e->count);
+		if (e->size <= 4) {
+			memcpy(p + 8, pool + e->value, e->size);
+		} else {
+			put32(p + 8, valuePos);
+			memcpy(out + valuePos, pool + e->value, e->size);
+			valuePos += (e->size + 1) & ~1u;
+		}
+	}
+	put32(out + pos + 2 + 12 * d->numEntries, next);
+}
+
+// compress writes a width by height test image as a JPEG file, with the APP1
+// segment app1 if it isn't NULL, to f or, if f is NULL, to memory.
+static void
+compress(FILE* f, unsigned char** mem, unsigned long* memSize, int width, int height,
+		const uint8_t* app1, unsigned int app1Size) {
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	JSAMPROW row = (JSAMPROW)malloc(width * 3);
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	if (f != NULL) jpeg_stdio_dest(&cinfo, f);
+	else jpeg_mem_dest(&cinfo, mem, memSize);
+	cinfo.image_width = width;
+	cinfo.image_height = height;
+	cinfo.input_components = 3;
+	cinfo.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&cinfo);
+	cinfo.write_JFIF_header = FALSE;
+	jpeg_start_compress(&cinfo, TRUE);
+	if (app1 != NULL) jpeg_write_marker(&cinfo, JPEG_APP0 + 1, app1, app1Size);
+	while (cinfo.next_scanline < cinfo.image_height) {
+		for (int x = 0; x < width * 3; x++) row[x] = (JSAMPLE)((x * 7 + cinfo.next_scanline * 3) & 255);
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+	jpeg_destroy_compress(&cinfo);
+	free(row);
+}
+
+struct options {
+	int tags;
+	int valueSize;
+	int byteOrder;  // 0 little endian, 1 big endian, 2 mixed
+	boolean gps;
+	int thumbSize;
+	int makerNoteSize;
+};
+
+#define BASE_TAGS 19
+
+// buildApp1 builds the APP1 payload of file number n in app1 and returns its
+// size, or 0 if it doesn't fit in a segment.
+static unsigned int
+buildApp1(const struct options* opt, int n, uint8_t* app1) {
+	static const uint16_t extraTypes[] = { TIFF_TYPE_ASCII, TIFF_TYPE_SHORT, TIFF_TYPE_LONG, TIFF_TYPE_RATIONAL };
+	unsigned char* thumb = NULL;
+	unsigned long thumbSize = 0;
+	uint32_t pairs[6];
+
+	bigEndian = opt->byteOrder == 2 ? (n & 1) : opt->byteOrder;
+	poolUsed = 0;
+	ifd0.numEntries = exifIFD.numEntries = gpsIFD.numEntries = ifd1.numEntries = 0;
+
+	addText(&ifd0, TIFFMake, "Gen", opt->valueSize);
+	addText(&ifd0, TIFFModel, "Model ", opt->valueSize);
+	addShort(&ifd0, TIFFOrientation, 1 + nextRandom() % 8);
+	addRational(&ifd0, TIFFXResolution, 72, 1);
+	addRational(&ifd0, TIFFYResolution, 72, 1);
+	addShort(&ifd0, TIFFResolutionUnit, 2);
+	addText(&ifd0, TIFFSoftware, "exifgen ", opt->valueSize);
+	addDate(&ifd0, TIFFDateTime);
+	addLong(&ifd0, 0x8769, 0);  // Exif IFD pointer
+	if (opt->gps) addLong(&ifd0, 0x8825, 0);  // GPS IFD pointer
+
+	addRational(&exifIFD, EXIFExposureTime, 1, 30 + nextRandom() % 4000);
+	addRational(&exifIFD, EXIFFNumber, 14 + nextRandom() % 200, 10);
+	addShort(&exifIFD, EXIFPhotographicSensitivity, 100 << (nextRandom() % 6));
+	addDate(&exifIFD, EXIFDateTimeOriginal);
+	addDate(&exifIFD, EXIFDateTimeDigitized);
+	pairs[0] = (uint32_t)-(int32_t)(nextRandom() % 6);
+	pairs[1] = 3;
+	addRationals(&exifIFD, EXIFExposureBiasValue, TIFF_TYPE_SRATIONAL, pairs, 1);
+	addRational(&exifIFD, EXIFFocalLength, 100 + nextRandom() % 3000, 10);
+	addLong(&exifIFD, EXIFPixelXDimension, 6000);
+	addLong(&exifIFD, EXIFPixelYDimension, 4000);
+	addText(&exifIFD, EXIFLensModel, "Lens ", opt->valueSize);
+	addText(&exifIFD, EXIFBodySerialNumber, "", opt->valueSize);
+	for (int i = BASE_TAGS; i < opt->tags && exifIFD.numEntries < MAX_TAGS - 1; i++) {
+		uint16_t tag = (uint16_t)(0xC000 + i);
+		switch (extraTypes[i % 4]) {
+		case TIFF_TYPE_ASCII: addText(&exifIFD, tag, "", opt->valueSize); break;
+		case TIFF_TYPE_SHORT: addShort(&exifIFD, tag, nextRandom() & 0xFFFF); break;
+		case TIFF_TYPE_LONG: addLong(&exifIFD, tag, nextRandom()); break;
+		default: addRational(&exifIFD, tag, nextRandom() % 1000, 1 + nextRandom() % 1000); break;
+		}
+	}
+	if (opt->makerNoteSize > 0) addBytes(&exifIFD, EXIFMakerNote, TIFF_TYPE_UNDEFINED, opt->makerNoteSize);
+
+	if (opt->gps) {
+		static const uint8_t version[4] = { 2, 3, 0, 0 };
+		memcpy(addEntry(&gpsIFD, GPSVersionID, TIFF_TYPE_BYTE, 4, 4), version, 4);
+		addText(&gpsIFD, GPSLatitudeRef, nextRandom() & 1 ? "N" : "S", 1);
+		pairs[0] = nextRandom() % 90; pairs[1] = 1;
+		pairs[2] = nextRandom() % 60; pairs[3] = 1;
+		pairs[4] = nextRandom() % 6000; pairs[5] = 100;
+		addRationals(&gpsIFD, GPSLatitude, TIFF_TYPE_RATIONAL, pairs, 3);
+		addText(&gpsIFD, GPSLongitudeRef, nextRandom() & 1 ? "E" : "W", 1);
+		pairs[0] = nextRandom() % 180;
+		addRationals(&gpsIFD, GPSLongitude, TIFF_TYPE_RATIONAL, pairs, 3);
+		addBytes(&gpsIFD, GPSAltitudeRef, TIFF_TYPE_BYTE, 1);
+		addRational(&gpsIFD, GPSAltitude, nextRandom() % 50000, 10);
+		pairs[0] = nextRandom() % 24; pairs[2] = nextRandom() % 60; pairs[4] = nextRandom() % 60; pairs[5] = 1;
+		addRationals(&gpsIFD, GPSTimeStamp, TIFF_TYPE_RATIONAL, pairs, 3);
+		addText(&gpsIFD, GPSDateStamp, "2024:01:01", 10);
+	}
+
+	if (opt->thumbSize > 0) {
+		compress(NULL, &thumb, &thumbSize, opt->thumbSize, opt->thumbSize * 3 / 4, NULL, 0);
+		addShort(&ifd1, TIFFCompression, 6);
+		addLong(&ifd1, TIFFJPEGInterchangeFormat, 0);
+		addLong(&ifd1, TIFFJPEGInterchangeFormatLength, (uint32_t)thumbSize);
+	}
+
+	// lay out the IFDs, then fill in the offsets between them
+	uint32_t exifPos = 8 + ifdSize(&ifd0);
+	uint32_t gpsPos = exifPos + ifdSize(&exifIFD);
+	uint32_t ifd1Pos = gpsPos + (opt->gps ? ifdSize(&gpsIFD) : 0);
+	uint32_t thumbPos = ifd1Pos + (opt->thumbSize > 0 ? ifdSize(&ifd1) : 0);
+	uint32_t tiffSize = thumbPos + (uint32_t)thumbSize;
+	if (6 + tiffSize > MAX_APP1) {
+		free(thumb);
+		return 0;
+	}
+	setLong(&ifd0, 0x8769, exifPos);
+	setLong(&ifd0, 0x8825, gpsPos);
+	setLong(&ifd1, TIFFJPEGInterchangeFormat, thumbPos);
+
+	uint8_t* tiff = app1 + 6;
+	memcpy(app1, "Exif\0\0", 6);
+	memcpy(tiff, bigEndian ? "MM" : "II", 2);
+	put16(tiff + 2, 42);
+	put32(tiff + 4, 8);
+	writeIFD(tiff, 8, &ifd0, opt->thumbSize > 0 ? ifd1Pos : 0);
+	writeIFD(tiff, exifPos, &exifIFD, 0);
+	if (opt->gps) writeIFD(tiff, gpsPos, &gpsIFD, 0);
+	if (opt->thumbSize > 0) {
+		writeIFD(tiff, ifd1Pos, &ifd1, 0);
+		memcpy(tiff + thumbPos, thumb, thumbSize);
+	}
+	free(thumb);
+	return 6 + tiffSize;
+}
+
+static int
+usage(const char* name) {
+	fprintf(stderr, "usage: %s [-n files] [-t tags] [-v valuesize] [-b le|be|mixed] [-g] [-T thumbsize] "
+		"[-M makernotesize] [-W width] [-s seed] [-r] outdir\n", name);
+	return 2;
+}
+
+int
+main(int argc, char** argv) {
+	struct options opt = { BASE_TAGS, 16, 0, FALSE, 0, 0 };
+	int numFiles = 100, width = 1920;
+	boolean raw = FALSE;
+	static uint8_t app1[MAX_APP1];
+	char path[4096];
+	int i;
+
+	randomState = 1;
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		const char* a = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (strcmp(a, "-g") == 0) { opt.gps = TRUE; continue; }
+		if (strcmp(a, "-r") == 0) { raw = TRUE; continue; }
+		if (value == NULL) return usage(argv[0]);
+		i++;
+		if (strcmp(a, "-n") == 0) numFiles = atoi(value);
+		else if (strcmp(a, "-t") == 0) opt.tags = atoi(value);
+		else if (strcmp(a, "-v") == 0) opt.valueSize = atoi(value);
+		else if (strcmp(a, "-T") == 0) opt.thumbSize = atoi(value);
+		else if (strcmp(a, "-M") == 0) opt.makerNoteSize = atoi(value);
+		else if (strcmp(a, "-W") == 0) width = atoi(value);
+		else if (strcmp(a, "-s") == 0) randomState = (uint32_t)strtoul(value, NULL, 0);
+		else if (strcmp(a, "-b") == 0 && strcmp(value, "le") == 0) opt.byteOrder = 0;
+		else if (strcmp(a, "-b") == 0 && strcmp(value, "be") == 0) opt.byteOrder = 1;
+		else if (strcmp(a, "-b") == 0 && strcmp(value, "mixed") == 0) opt.byteOrder = 2;
+		else return usage(argv[0]);
+	}
+	if (i != argc - 1 || numFiles < 0 || opt.valueSize < 1 || opt.thumbSize < 0 ||
+		opt.makerNoteSize < 0 || width < 8) return usage(argv[0]);
+	if (!raw && opt.thumbSize >= width) {
+		fprintf(stderr, "the thumbnail has to be smaller than the main image, use a smaller -T or a larger -W\n");
+		return 1;
+	}
+	if (randomState == 0) randomState = 1;
+
+	for (int n = 0; n < numFiles; n++) {
+		unsigned int size = buildApp1(&opt, n, app1);
+		if (size == 0) {
+			fprintf(stderr, "the EXIF data doesn't fit in an APP1 segment, use fewer or smaller tags\n");
+			return 1;
+		}
+		snprintf(path, sizeof(path), "%s/gen%05d.%s", argv[i], n, raw ? "app1" : "jpg");
+		FILE* f = fopen(path, "wb");
+		if (f == NULL) {
+			fprintf(stderr, "can't write %s\n", path);
+			return 1;
+		}
+		if (raw) fwrite(app1, 1, size, f);
+		else compress(f, NULL, NULL, width, width * 3 / 4, app1, size);
+		fclose(f);
+	}
+	return 0;
+}
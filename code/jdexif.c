@@ -1,368 +1,1951 @@
-
-
-
-
-#include <stdio.h>
-#include "jinclude.h"
-#include "jpeglib.h"
-#include "jerror.h"
-#include "jdexif.h"
-
-
-/* Declare and initialize local copies of input pointer/count */
-#define INPUT_VARS(cinfo)  \
-	struct jpeg_source_mgr * datasrc = (cinfo)->src;  \
-	const JOCTET * next_input_byte = datasrc->next_input_byte;  \
-	size_t bytes_in_buffer = datasrc->bytes_in_buffer
-
-/* Unload the local copies --- do this only at a restart boundary */
-#define INPUT_SYNC(cinfo)  \
-	( datasrc->next_input_byte = next_input_byte,  \
-	  datasrc->bytes_in_buffer = bytes_in_buffer )
-
-/* Reload the local copies --- used only in MAKE_BYTE_AVAIL */
-#define INPUT_RELOAD(cinfo)  \
-	( next_input_byte = datasrc->next_input_byte,  \
-	  bytes_in_buffer = datasrc->bytes_in_buffer )
-
-/* Internal macro for INPUT_BYTE and INPUT_2BYTES: make a byte available.
- * Note we do *not* do INPUT_SYNC before calling fill_input_buffer,
- * but we must reload the local copies after a successful fill.
- */
-#define MAKE_BYTE_AVAIL(cinfo,action)  \
-	if (bytes_in_buffer == 0) {  \
-	  if (! (*datasrc->fill_input_buffer) (cinfo))  \
-	    { action; }  \
-	  INPUT_RELOAD(cinfo);  \
-	}
-
- /* Read a byte into variable V.
-  * If must suspend, take the specified action (typically "return FALSE").
-  */
-#define INPUT_BYTE(cinfo,V,action)  \
-	MAKESTMT( MAKE_BYTE_AVAIL(cinfo,action); \
-		  bytes_in_buffer--; \
-		  V = GETJOCTET(*next_input_byte++); )
-
-  /* As above, but read two bytes interpreted as an unsigned 16-bit integer.
-   * V should be declared unsigned int or perhaps INT32.
-   */
-#define INPUT_2BYTES(cinfo,V,action)  \
-	MAKESTMT( MAKE_BYTE_AVAIL(cinfo,action); \
-		  bytes_in_buffer--; \
-		  V = ((unsigned int) GETJOCTET(*next_input_byte++)) << 8; \
-		  MAKE_BYTE_AVAIL(cinfo,action); \
-		  bytes_in_buffer--; \
-		  V += GETJOCTET(*next_input_byte++); )
-
-
-	 
-// this section of code implements a map of IFDs.  
-// Allows the parsed IFDs to be looked up by tag.
-
-struct tagentry {
-	uint16_t tag; // tiff, exif or gps tag
-	uint16_t type; // data type as defined in the TIFF file spec
-	uint32_t count; // count of the data of type above
-	uint8_t* pvalue; // a pointer to said data.
-	struct tagentry* next;
-};
-
-static struct tagentry* tagmap = NULL;
-
-// this are the size of the types defined in the type fiels of a IFD
-static int typeSize[] = { 0,1,1,2,4,8,0,1,0,4,8 };
-
-
-// tagmapAdd adds a new entry to the front of the map.
-static void 
-tagmapAdd(uint32_t tag, uint32_t type, uint32_t count, uint8_t* pval) {
-	//allocate a new tagentry and put it on the list
-	struct tagentry* newTagEntry = (struct tagentry*)malloc(sizeof(struct tagentry));
-	newTagEntry->next = tagmap;
-	tagmap = newTagEntry;
-	
-	// copy in the basics
-	newTagEntry->tag = (uint16_t)tag;
-	newTagEntry->type = type;
-	newTagEntry->count = count;
-	uint32_t numBytes = count * typeSize[type];
-	newTagEntry->pvalue = (uint8_t*)malloc(numBytes);
-	if (newTagEntry->pvalue != NULL) {
-		for (unsigned int i = 0; i < numBytes; i++)
-			newTagEntry->pvalue[i] = pval[i];
-	}
-}
-
-// looks up a tagmap entry by tag.
-static struct tagentry* 
-tagmapFind(uint16_t tag) {
-	struct tagentry* current = tagmap;
-	while (current != NULL) {
-		if (current->tag == tag) break;
-		current = current->next;
-	}
-	return current;
-}
-
-// tagmapFree frees the data in the tag map.
-GLOBAL(void)
-tagmapFree() {
-	struct tagentry* current = tagmap;
-	struct tagentry* next;
-	while (current != NULL) {
-		free(current->pvalue);
-		next = current->next;
-		free(current);
-		current = next;
-	}
-	tagmap = NULL;
-}
-
-// tagmapPrint, prints all the IFD data in the tag map.
-GLOBAL(boolean)
-tagmapPrint() {
-	struct tagentry* current = tagmap;
-	char avals[100];
-	uint32_t uivals[10];
-	int32_t ivals[10];
-	double dvals[10];
-	while (current != NULL) {
-		printf("%04x %2x %04x, ", current->tag, current->type, current->count);
-		if (current->type == TIFF_TYPE_BYTE || current->type == TIFF_TYPE_SHORT ||
-			current->type == TIFF_TYPE_LONG || current->type == TIFF_TYPE_UNDEFINED) {
-			int cnt = exifUIntData(current->tag, uivals);
-			for (int i = 0; i < cnt; i++) printf("%8d ", uivals[i]);
-		}
-		if (current->type == TIFF_TYPE_SLONG) {
-			int cnt = exifIntData(current->tag, ivals);
-			for (int i = 0; i < cnt; i++) printf("%8d ", ivals[i]);
-		}
-		if (current->type == TIFF_TYPE_ASCII) {
-			int cnt = exifASCIIData(current->tag, avals);
-			printf("%s ", avals);
-		}
-		if (current->type == TIFF_TYPE_RATIONAL || current->type == TIFF_TYPE_SRATIONAL) {
-			int cnt = exifRationalData(current->tag, dvals);
-			for (int i = 0; i < cnt; i++) printf("%lf ", dvals[i]);
-		}
-		printf("\n");
-
-		/*
-		printf("% 04x %2x %04x, ", current->tag, current->type, current->count);
-		uint32_t numBytes = current->count * typeSize[current->type];
-		for (int i = 0; i < numBytes; i++) printf("% 02x ", current->pvalue[i]);
-		printf("\n");
-		*/
-		current = current->next;
-	}
-	return TRUE;
-}
-
-
-static boolean
-proocess_subIFD_tags(uint8_t* data, uint32_t offset) {
-
-	uint32_t number_of_tags, tagnum;
-	uint32_t type, count;
-	uint32_t dataOffset;
-
-	/* Get the number of directory entries contained in this SubIFD */
-	number_of_tags = ((uint32_t)data[offset + 1] << 8) + data[offset];
-	if (number_of_tags < 2) return FALSE;
-	offset += 2;
-
-	/* Search for ExifImageWidth and ExifImageHeight Tags in this SubIFD */
-	do {
-		/* Get Tag number */
-		tagnum = ((uint32_t)data[offset + 1] << 8) + data[offset];
-		type = ((uint32_t)data[offset + 3] << 8) + data[offset + 2];
-		count = ((uint32_t)data[offset + 7] << 24) + ((uint32_t)data[offset + 6] << 16) +
-			((uint32_t)data[offset + 5] << 8) + data[offset + 4];
-		uint32_t numBytes = count * typeSize[type];
-		if (numBytes <= 4) {
-			tagmapAdd(tagnum, type, count, &(data[offset + 8]));
-		} else {
-			dataOffset = ((uint32_t)data[offset + 11] << 24) + ((uint32_t)data[offset + 10] << 16) +
-				((uint32_t)data[offset + 9] << 8) + data[offset + 8];
-			dataOffset += 6;  // offset to the beginning of the TIFF data field.
-			tagmapAdd(tagnum, type, count, (data+dataOffset));
-		}
-		offset += 12;
-	} while (--number_of_tags);
-	return TRUE;
-}
-
-
-boolean
-process_exif_parameters(j_decompress_ptr cinfo) {
-	boolean is_motorola; /* Flag for byte order */
-	int32_t numberOfTags, tagnum;
-	int32_t firstOffset, offset;
-	uint32_t type, count;
-	uint32_t dataOffset;
-	boolean returnBool = FALSE;
-
-	int32_t length;
-	
-	INPUT_VARS(cinfo);
-
-	// read the size of the data for marker APP1
-	INPUT_2BYTES(cinfo, length, return FALSE);
-	length -= 2;
-
-	/* check for a reasonable length of an IFD entry */
-	if (length <= 0) return FALSE; 
-
-	uint8_t* data = (uint8_t*)malloc(length * sizeof(uint8_t));
-	if (data == NULL) return FALSE;
-
-	// read the data for marker APP1 into a temporary data[] buffer 
-	for (int i = 0; i < length; i++) {
-		INPUT_BYTE(cinfo, data[i], return FALSE);
-	}
-	INPUT_SYNC(cinfo);
-
-	/* Check to see that this is EXIF data 
-	   If it not EXIF data don't fail because this could be other APP1 data
-		 but don't continue to parse the data.*/
-	if (0 != strcmp((char*)data, "Exif")) {
-		returnBool = TRUE;
-		goto freeAndReturn;
-	}
-
-	// if there is exif data from a previous file, clear it.
-	tagmapFree();
-
-	/* Discover byte order */
-	if (data[6] == 0x49 && data[7] == 0x49)
-		is_motorola = FALSE;
-	else if (data[6] == 0x4D && data[7] == 0x4D)
-		goto freeAndReturn;  // Bigendean is not supported.
-	else
-		goto freeAndReturn;  // Expected endian code was not found
-
-	/* Check Tag Mark */
-	uint32_t tagMark = ((uint32_t)data[9] << 8) + data[8];
-	if (tagMark != 0x2A) goto freeAndReturn;
-
-	/* Get first IFD offset (offset to IFD0) */
-
-	firstOffset = ((uint32_t)data[13] << 24) + ((uint32_t)data[12] << 16) +
-		((uint32_t)data[11] << 8) + data[10];
-	firstOffset += 6; // account for Exif strng at the begining of the buffer;
-
-	/* Get the number of directory entries contained in this IFD */
-
-	numberOfTags = ((uint32_t)data[firstOffset + 1] << 8) + data[firstOffset];
-	if (numberOfTags == 0) goto freeAndReturn;
-	firstOffset += 2;
-
-	/* Search for ExifSubIFD offset Tag in IFD0 */
-	for (;;) {
-		if (firstOffset > length - 12) goto freeAndReturn; /* check end of data segment */
-		/* Get Tag number */
-		tagnum = ((uint32_t)data[firstOffset + 1] << 8) + data[firstOffset];
-		if (tagnum == 0x8769 || tagnum == 0x8825) { /* found ExifSubIFD or GPSSubIDF offset Tag */
-			offset = ((uint32_t)data[firstOffset + 11] << 24) + ((uint32_t)data[firstOffset + 10] << 16) +
-				((uint32_t)data[firstOffset + 9] << 8) + data[firstOffset + 8];
-			offset += 6;  // tiff header starts at data[6]
-			if (!proocess_subIFD_tags(data, offset)) { goto freeAndReturn; }
-		}	else { // Otherwise addd the IDF to the tagmap.
-			type = ((uint32_t)data[firstOffset + 3] << 8) + data[firstOffset + 2];
-			count = ((uint32_t)data[firstOffset + 7] << 24) + ((uint32_t)data[firstOffset + 6] << 16) +
-				((uint32_t)data[firstOffset + 5] << 8) + data[firstOffset + 4];
-			uint32_t numBytes = count * typeSize[type];
-			if (numBytes <= 4) {
-				tagmapAdd(tagnum, type, count, &(data[firstOffset + 8]));
-			} else {
-				dataOffset = ((uint32_t)data[firstOffset + 11] << 24) + ((uint32_t)data[firstOffset + 10] << 16) +
-					((uint32_t)data[firstOffset + 9] << 8) + data[firstOffset + 8];
-				dataOffset += 6;  // offset to the beginning of the TIFF data field.
-				tagmapAdd(tagnum, type, count, (data + dataOffset));
-			}
-		}
-		if (--numberOfTags == 0) { break; }
-		firstOffset += 12;
-	}
-
-freeAndReturn:
-	free(data);
-	return TRUE;
-}
-
-int exifUIntData(uint16_t tag, uint32_t* vals) {
-	struct tagentry* current = tagmapFind(tag);
-	if (current == NULL) return 0;  // tag not found
-	if (current->type == TIFF_TYPE_BYTE || current->type == TIFF_TYPE_UNDEFINED) {
-		for (unsigned int i = 0; i < current->count; i++) {
-			vals[i] = current->pvalue[i];
-		}
-	} else if (current->type == TIFF_TYPE_SHORT) {
-		for (unsigned int i = 0; i < current->count; i++) {
-			int n = i * 2;
-			vals[i] = current->pvalue[n] + ((uint32_t)current->pvalue[n + 1] << 8);
-		}
-	}	else if (current->type == TIFF_TYPE_LONG) {
-		for (unsigned int i = 0; i < current->count; i++) {
-			int n = i * 4;
-			vals[i] = current->pvalue[n] + ((uint32_t)current->pvalue[n + 1] << 8) +
-				((uint32_t)current->pvalue[n + 2] << 16) + ((uint32_t)current->pvalue[n + 3] << 24);
-		}
-	}	else return -1;  // call doesent match IFD type so return -1	
-	return current->count; // return the number of data words place in the vals array
-}
-
-int exifIntData(uint16_t tag, int32_t* vals) {
-	struct tagentry* current = tagmapFind(tag);
-	if (current == NULL) return 0;  // tag not found
-	if (current->type == TIFF_TYPE_SLONG) {
-		for (unsigned int i = 0; i < current->count; i++) {
-			int n = i * 4;
-			vals[i] = current->pvalue[n] + ((int32_t)current->pvalue[n + 1] << 8) +
-				((int32_t)current->pvalue[n + 2] << 16) + ((int32_t)current->pvalue[n + 3] << 24);
-		}
-	}	else return -1;  // call doesent match IFD type so return -1;
-	return current->count;  // return the number of data words place in the vals array
-}
-
-int exifASCIIData(uint16_t tag, char* vals) {
-	struct tagentry* current = tagmapFind(tag);
-	if (current == NULL) return 0;  // tag not found
-	if (current->type == TIFF_TYPE_ASCII) {
-		for (unsigned int i = 0; i < current->count; i++) {
-			vals[i] = current->pvalue[i];
-		}
-	}	else return -1;  // call doesent match IFD type so return -1;
-	return current->count; // return the number of data words place in the vals array
-}
-
-int exifRationalData(uint16_t tag, double* vals) {
-	struct tagentry* current = tagmapFind(tag);
-	if (current == NULL) return 0;  // tag not found
-	double val;
-	if (current->type == TIFF_TYPE_RATIONAL) {
-		for (unsigned int i = 0; i < current->count; i++) {
-			int n = i * 8;
-			uint32_t numerator = current->pvalue[n] + ((uint32_t)current->pvalue[n + 1] << 8) +
-				((uint32_t)current->pvalue[n + 2] << 16) + ((uint32_t)current->pvalue[n + 3] << 24);
-			uint32_t denominator = current->pvalue[n + 4] + ((uint32_t)current->pvalue[n + 5] << 8) +
-				((uint32_t)current->pvalue[n + 6] << 16) + ((uint32_t)current->pvalue[n + 7] << 24);
-			if (denominator == 0) val = 0;
-			else val = (double)numerator / (double)denominator;
-			vals[i] = val;
-		}
-	} else	if (current->type == TIFF_TYPE_SRATIONAL) {
-		for (unsigned int i = 0; i < current->count; i++) {
-			int n = i * 8;
-			int32_t numerator = current->pvalue[n] + ((int32_t)current->pvalue[n + 1] << 8) +
-				((int32_t)current->pvalue[n + 2] << 16) + ((int32_t)current->pvalue[n + 3] << 24);
-			int32_t denominator = current->pvalue[n + 4] + ((int32_t)current->pvalue[n + 5] << 8) +
-				((int32_t)current->pvalue[n + 6] << 16) + ((int32_t)current->pvalue[n + 7] << 24);
-			if (denominator == 0) val = 0;
-			else val = (double)numerator / (double)denominator;
-			vals[i] = val;
-		}
-	} else return -1;  // call doesent match IFD type so return -1;
-	return current->count; // return the number of data words place in the vals array
-}
+
+
+
+
+#define JPEG_INTERNALS  /* for the marker reader exifAttach hooks */
+#include <stdio.h>
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jerror.h"
+#include "jdexif.h"
+#include "jdexifint.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define USE_MMAP   /* map files read by exifParseFile instead of reading them */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef EXIF_STATS
+#include <time.h>
+#endif
+
+#if defined(EXIF_NO_SIMD)
+	/* convert values one at a time, for comparison */
+#elif defined(__SSE2__) || defined(_M_X64)
+#define USE_SSE2   /* convert arrays of values 16 bytes at a time */
+#include <emmintrin.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+#elif defined(__ARM_NEON) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define USE_NEON
+#include <arm_neon.h>
+#endif
+
+
+/* Declare and initialize local copies of input pointer/count */
+#define INPUT_VARS(cinfo)  \
+	struct jpeg_source_mgr * datasrc = (cinfo)->src;  \
+	const JOCTET * next_input_byte = datasrc->next_input_byte;  \
+	size_t bytes_in_buffer = datasrc->bytes_in_buffer
+
+/* Unload the local copies --- do this only at a restart boundary */
+#define INPUT_SYNC(cinfo)  \
+	( datasrc->next_input_byte = next_input_byte,  \
+	  datasrc->bytes_in_buffer = bytes_in_buffer )
+
+/* Reload the local copies --- used only in MAKE_BYTE_AVAIL */
+#define INPUT_RELOAD(cinfo)  \
+	( next_input_byte = datasrc->next_input_byte,  \
+	  bytes_in_buffer = datasrc->bytes_in_buffer )
+
+/* Internal macro for INPUT_BYTE and INPUT_2BYTES: make a byte available.
+ * Note we do *not* do INPUT_SYNC before calling fill_input_buffer,
+ * but we must reload the local copies after a successful fill.
+ */
+#define MAKE_BYTE_AVAIL(cinfo,action)  \
+	if (bytes_in_buffer == 0) {  \
+	  if (! (*datasrc->fill_input_buffer) (cinfo))  \
+	    { action; }  \
+	  INPUT_RELOAD(cinfo);  \
+	}
+
+ /* Read a byte into variable V.
+  * If must suspend, take the specified action (typically "return FALSE").
+  */
+#define INPUT_BYTE(cinfo,V,action)  \
+	MAKESTMT( MAKE_BYTE_AVAIL(cinfo,action); \
+		  bytes_in_buffer--; \
+		  V = GETJOCTET(*next_input_byte++); )
+
+  /* As above, but read two bytes interpreted as an unsigned 16-bit integer.
+   * V should be declared unsigned int or perhaps INT32.
+   */
+#define INPUT_2BYTES(cinfo,V,action)  \
+	MAKESTMT( MAKE_BYTE_AVAIL(cinfo,action); \
+		  bytes_in_buffer--; \
+		  V = ((unsigned int) GETJOCTET(*next_input_byte++)) << 8; \
+		  MAKE_BYTE_AVAIL(cinfo,action); \
+		  bytes_in_buffer--; \
+		  V += GETJOCTET(*next_input_byte++); )
+
+
+	 
+// this section of code implements a map of IFDs.  
+// Allows the parsed IFDs to be looked up by IFD and tag.
+// The entries are struct tagentry, see jdexifint.h.
+
+// An exif_context holds the tag map for one image.  Each decompressor that
+// needs its own EXIF data gets its own context (see exifAttach), so several
+// images can be decoded in parallel.  The original non-reentrant functions
+// all operate on default_context.
+// The tag values are not copied.  The APP1 segment they were parsed from is
+// kept alive as long as the tags are, and each entry records where its value
+// lives in that segment.
+// The entries, and the segment itself when it has to be read into memory,
+// are carved from one arena.  It is sized from the APP1 length and kept when
+// the tags are freed, so a context that is reused for many files stops
+// allocating once it has seen its largest segment.
+// The entries are kept in one array in the order they were parsed and are
+// indexed by an open addressed hash table keyed by IFD and tag.
+// ifds records where the entries of each IFD are in the segment.  It is
+// used by lazy parsing to decode entries when they are first looked up.
+struct exif_arena {
+	uint8_t* base;
+	size_t size;
+	size_t used;
+};
+
+struct ifdinfo {
+	uint32_t offset;  // offset of the first entry in the segment
+	uint32_t count;   // number of entries
+	boolean located;  // offset and count are known and checked
+	boolean sorted;   // the entries are in ascending tag order, as they should be
+};
+
+// LAZY_MISSES is the number of lookups of tags that are not in their IFD a
+// lazily parsed segment remembers, so the IFD isn't searched for them again.
+#define LAZY_MISSES 64
+
+// CAPTURE_HEADER is the number of bytes at the start of a segment needed to
+// tell what it holds; the longest signature is XMP's 29.
+#define CAPTURE_HEADER 32
+
+// segment_reader keeps the progress of an APPn segment that is read from a
+// source manager, so that the read can resume after the source suspends.
+struct segment_reader {
+	int32_t length;      // length of the segment being read, 0 if none
+	int32_t bytesRead;   // bytes of it read so far
+	uint8_t* data;       // where the segment goes, NULL while reading the header
+	int kind;            // EXIF_METADATA_ kind of a captured segment, 0 for EXIF
+	size_t offset;       // of a captured segment in ctx->meta
+	uint8_t header[CAPTURE_HEADER];
+};
+
+// A capture is a metadata segment kept with the tags, without its
+// signature.  view points to it in the input when that outlives the parse,
+// otherwise it was copied to offset in the metadata buffer of the context.
+struct capture {
+	const uint8_t* view;
+	size_t offset;
+	size_t size;
+};
+
+struct exif_context {
+	struct tagentry* entries;
+	uint32_t numEntries;
+	uint32_t maxEntries;
+	struct tagentry* moreEntries; // entries that outgrew the arena, or NULL
+	uint32_t misses[LAZY_MISSES]; // keys lazy lookups didn't find
+	uint32_t numMisses;
+	uint32_t* hash;       // generation << 16 | entry index + 1 for each slot
+	uint32_t hashMask;
+	uint32_t hashCapacity;
+	uint32_t generation;  // slots from other generations are empty
+	const uint8_t* data;  // the APP1 segment the tag values point into
+	int32_t length;
+	boolean bigEndian;    // the segment is in Motorola byte order
+	struct exif_arena arena;
+	void* map;            // mapped file that holds the segment
+	size_t mapSize;
+	struct ifdinfo ifds[EXIF_IFD_1 + 1];
+	unsigned int options; // EXIF_OPTION_ flags
+	const struct exif_interest* interest; // the tags to keep, NULL for all
+	uint32_t blobLimit;   // bytes of UNDEFINED tags the blob and raw accessors give, 0 for no limit
+	struct segment_reader reader;
+	void (*resetMarkers)(j_decompress_ptr cinfo); // the reset exifAttach wrapped
+	uint64_t bytesCopied; // bytes copied out of the input since ctx was created
+	uint64_t bytesRead;   // bytes exifParseFile read from the last file
+	uint8_t* meta;        // metadata segments that had to be copied
+	size_t metaSize;
+	size_t metaUsed;
+	boolean metaViews;    // some captures point into the input
+	struct capture xmp;
+	struct capture mpf;
+	struct capture icc;   // the whole profile, once its chunks are put together
+	uint32_t iccChunks;   // number of chunks of the profile, 0 if none seen
+	struct capture iccChunk[256];  // by sequence number, from 1
+#ifdef EXIF_STATS
+	struct exif_stats stats;
+#endif
+};
+
+static struct exif_context default_context;
+
+// All the memory of the extension comes from allocMem and goes back through
+// freeMem.  exifSetAllocator replaces them.
+static void* (*allocMem)(size_t) = malloc;
+static void (*freeMem)(void*) = free;
+
+// STAT_ADD adds n to a counter of the statistics of ctx, if they are kept.
+#ifdef EXIF_STATS
+#define STAT_ADD(ctx, counter, n)  ((ctx)->stats.counter += (n))
+#else
+#define STAT_ADD(ctx, counter, n)  ((void)(ctx))
+#endif
+
+// An exif_interest has a bit for each tag of each IFD that is kept.
+struct exif_interest {
+	uint32_t count;  // number of bits set
+	uint8_t bits[EXIF_IFD_1][65536 / 8];
+};
+
+// interesting tells if the entries of tag in ifd are kept in ctx.
+#define interesting(ctx, ifd, tag)  ((ctx)->interest == NULL || \
+	((ctx)->interest->bits[(ifd) - 1][(tag) >> 3] >> ((tag) & 7) & 1))
+
+// this are the size of the types defined in the type fiels of a IFD
+static int typeSize[] = { 0,1,1,2,4,8,0,1,0,4,8 };
+
+// get16 and get32 read a SHORT or LONG from the segment in ctx in the byte
+// order its TIFF header gives.
+static uint32_t
+get16(j_exif_ptr ctx, const uint8_t* p) {
+	if (ctx->bigEndian) return ((uint32_t)p[0] << 8) + p[1];
+	return ((uint32_t)p[1] << 8) + p[0];
+}
+
+static uint32_t
+get32(j_exif_ptr ctx, const uint8_t* p) {
+	if (ctx->bigEndian)
+		return ((uint32_t)p[0] << 24) + ((uint32_t)p[1] << 16) + ((uint32_t)p[2] << 8) + p[3];
+	return ((uint32_t)p[3] << 24) + ((uint32_t)p[2] << 16) + ((uint32_t)p[1] << 8) + p[0];
+}
+
+// the IFDs searched, in order, when no IFD is given with the tag
+static const uint32_t searchOrder[] = { EXIF_IFD_0, EXIF_IFD_EXIF, EXIF_IFD_GPS, EXIF_IFD_1 };
+
+
+#define ARENA_ALIGN(n)  (((n) + 7) & ~(size_t)7)
+
+// arenaAlloc returns size bytes from the arena or NULL if it is full.
+static void*
+arenaAlloc(j_exif_ptr ctx, size_t size) {
+	struct exif_arena* arena = &ctx->arena;
+	size = ARENA_ALIGN(size);
+	if (size > arena->size - arena->used) return NULL;
+	arena->used += size;
+	return arena->base + arena->used - size;
+}
+
+// arenaPrepare empties the arena of ctx and sets up the entry array and hash
+// table for an APP1 segment of length bytes.  If withSegment is set, room for
+// the segment itself is reserved at the start of the arena.  Returns the
+// start of the arena, where the segment goes, or NULL if out of memory.
+static uint8_t*
+arenaPrepare(j_exif_ptr ctx, int32_t length, boolean withSegment) {
+	struct exif_arena* arena = &ctx->arena;
+	// every entry takes 12 bytes of the segment, and with an interest set
+	// there are seldom more entries than tags in the set; tagmapGrow makes
+	// room for the rest.  Lazy lookups may hold on to entries while adding
+	// more, so they always get room for the whole segment and never grow.
+	uint32_t maxEntries = length / 12 + 1;
+	if (ctx->interest != NULL && ctx->interest->count < maxEntries && !(ctx->options & EXIF_OPTION_LAZY))
+		maxEntries = ctx->interest->count + 1;
+	uint32_t hashSize = 16;
+	while (hashSize < 2 * maxEntries) hashSize *= 2;
+	size_t need = ARENA_ALIGN(maxEntries * sizeof(struct tagentry));
+	if (withSegment) need += ARENA_ALIGN((size_t)length);
+	ctx->numEntries = 0;
+	ctx->maxEntries = 0;
+	ctx->numMisses = 0;
+	freeMem(ctx->moreEntries);
+	ctx->moreEntries = NULL;
+	arena->used = 0;
+	if (need > arena->size) {
+		freeMem(arena->base);
+		arena->base = (uint8_t*)allocMem(need);
+		arena->size = arena->base != NULL ? need : 0;
+		if (arena->base == NULL) return NULL;
+		STAT_ADD(ctx, allocations, 1);
+		STAT_ADD(ctx, bytesAllocated, need);
+	}
+	// the hash table lives outside the arena so that it does not have to be
+	// cleared for every segment; bumping the generation empties it instead
+	if (hashSize > ctx->hashCapacity) {
+		freeMem(ctx->hash);
+		ctx->hash = (uint32_t*)allocMem(hashSize * sizeof(uint32_t));
+		ctx->hashCapacity = ctx->hash != NULL ? hashSize : 0;
+		if (ctx->hash == NULL) return NULL;
+		STAT_ADD(ctx, allocations, 1);
+		STAT_ADD(ctx, bytesAllocated, hashSize * sizeof(uint32_t));
+		ctx->generation = 0xFFFF;
+	}
+	if (++ctx->generation > 0xFFFF) {
+		memset(ctx->hash, 0, ctx->hashCapacity * sizeof(uint32_t));
+		ctx->generation = 1;
+	}
+	if (withSegment) arenaAlloc(ctx, (size_t)length);
+	ctx->entries = (struct tagentry*)arenaAlloc(ctx, maxEntries * sizeof(struct tagentry));
+	ctx->maxEntries = maxEntries;
+	ctx->hashMask = hashSize - 1;
+	memset(ctx->ifds, 0, sizeof(ctx->ifds));
+	return arena->base;
+}
+
+// hashSlot returns the first slot to probe for a key.
+#define hashSlot(ctx, key)  ((((key) * 0x9E3779B1u) >> 16) & (ctx)->hashMask)
+// hashLive tells if a slot holds an entry of the current segment.
+#define hashLive(ctx, slot)  (((ctx)->hash[slot] >> 16) == (ctx)->generation)
+
+// hashInsert indexes entry index of ctx under key.  An entry for the same
+// key is replaced.
+static void
+hashInsert(j_exif_ptr ctx, uint32_t key, uint32_t index) {
+	uint32_t slot = hashSlot(ctx, key);
+	while (hashLive(ctx, slot)) {
+		struct tagentry* e = &ctx->entries[(ctx->hash[slot] & 0xFFFF) - 1];
+		if (EXIF_IFD_KEY(e->ifd, e->tag) == key) break;
+		slot = (slot + 1) & ctx->hashMask;
+	}
+	ctx->hash[slot] = ctx->generation << 16 | (index + 1);
+}
+
+// tagmapGrow doubles the room for entries when a segment has more than
+// arenaPrepare expected, as when its IFDs overlap or repeat tags of the
+// interest set.  The entries move out of the arena and the hash table is
+// rebuilt to stay at most half full.  Returns FALSE if out of memory or if
+// the hash table can't index more entries.
+static boolean
+tagmapGrow(j_exif_ptr ctx) {
+	uint32_t maxEntries = ctx->maxEntries > 0x7FFF ? 0xFFFF : 2 * ctx->maxEntries;
+	if (maxEntries <= ctx->numEntries) return FALSE;
+	struct tagentry* entries = (struct tagentry*)allocMem(maxEntries * sizeof(struct tagentry));
+	if (entries == NULL) return FALSE;
+	STAT_ADD(ctx, allocations, 1);
+	STAT_ADD(ctx, bytesAllocated, maxEntries * sizeof(struct tagentry));
+	memcpy(entries, ctx->entries, ctx->numEntries * sizeof(struct tagentry));
+	freeMem(ctx->moreEntries);
+	ctx->entries = ctx->moreEntries = entries;
+	uint32_t hashSize = ctx->hashMask + 1;
+	if (hashSize >= 2 * maxEntries) {
+		ctx->maxEntries = maxEntries;
+		return TRUE;
+	}
+	while (hashSize < 2 * maxEntries) hashSize *= 2;
+	if (hashSize > ctx->hashCapacity) {
+		uint32_t* hash = (uint32_t*)allocMem(hashSize * sizeof(uint32_t));
+		if (hash == NULL) return FALSE;
+		STAT_ADD(ctx, allocations, 1);
+		STAT_ADD(ctx, bytesAllocated, hashSize * sizeof(uint32_t));
+		freeMem(ctx->hash);
+		ctx->hash = hash;
+		ctx->hashCapacity = hashSize;
+	}
+	memset(ctx->hash, 0, ctx->hashCapacity * sizeof(uint32_t));
+	ctx->generation = 1;
+	ctx->hashMask = hashSize - 1;
+	for (uint32_t i = 0; i < ctx->numEntries; i++)
+		hashInsert(ctx, EXIF_IFD_KEY(ctx->entries[i].ifd, ctx->entries[i].tag), i);
+	ctx->maxEntries = maxEntries;
+	return TRUE;
+}
+
+// tagmapProbe returns the entry for key in the hash table without decoding
+// anything.
+static struct tagentry*
+tagmapProbe(j_exif_ptr ctx, uint32_t key) {
+	uint32_t slot = hashSlot(ctx, key);
+	while (hashLive(ctx, slot)) {
+		struct tagentry* e = &ctx->entries[(ctx->hash[slot] & 0xFFFF) - 1];
+		if (EXIF_IFD_KEY(e->ifd, e->tag) == key) return e;
+		slot = (slot + 1) & ctx->hashMask;
+	}
+	return NULL;
+}
+
+// tagmapAdd adds a new entry to the map.  pval points to the value inside
+// ctx->data.  If the IFD already has an entry for the tag, the new entry
+// is written over it, so each tag is in the map once.  Returns FALSE if the
+// entry couldn't be added.
+static boolean
+tagmapAdd(j_exif_ptr ctx, uint32_t ifd, uint32_t tag, uint32_t type, uint32_t count, const uint8_t* pval) {
+	struct tagentry* newTagEntry = tagmapProbe(ctx, EXIF_IFD_KEY(ifd, tag));
+	if (newTagEntry == NULL) {
+		if (ctx->numEntries >= ctx->maxEntries && !tagmapGrow(ctx)) return FALSE;
+		newTagEntry = &ctx->entries[ctx->numEntries++];
+		STAT_ADD(ctx, tagsStored[ifd], 1);
+	}
+
+	// copy in the basics
+	newTagEntry->tag = (uint16_t)tag;
+	newTagEntry->type = type;
+	newTagEntry->count = count;
+	newTagEntry->offset = (uint32_t)(pval - ctx->data);
+	newTagEntry->ifd = ifd;
+
+	// and index it
+	hashInsert(ctx, EXIF_IFD_KEY(ifd, tag), (uint32_t)(newTagEntry - ctx->entries));
+	return TRUE;
+}
+
+static struct tagentry* lazyFind(j_exif_ptr ctx, uint32_t key);
+
+// tagmapFindKey looks up the entry for a tag in one IFD.
+static struct tagentry*
+tagmapFindKey(j_exif_ptr ctx, uint32_t key) {
+	if (ctx->maxEntries == 0) return NULL;
+#ifdef EXIF_LINEAR_LOOKUP
+	// the original linked list walk, newest entry first, for comparison
+	for (uint32_t i = ctx->numEntries; i-- > 0; ) {
+		struct tagentry* e = &ctx->entries[i];
+		if (EXIF_IFD_KEY(e->ifd, e->tag) == key) return e;
+	}
+#else
+	struct tagentry* e = tagmapProbe(ctx, key);
+	if (e != NULL) return e;
+#endif
+	if (ctx->options & EXIF_OPTION_LAZY) return lazyFind(ctx, key);
+	return NULL;
+}
+
+// looks up a tagmap entry by tag.  The IFD is given in the upper 16 bits of
+// tag (see EXIF_IFD_KEY); if it is EXIF_IFD_ANY the IFDs are searched in
+// searchOrder.
+static struct tagentry* 
+tagmapFind(j_exif_ptr ctx, uint32_t tag) {
+	if ((tag >> 16) != EXIF_IFD_ANY) return tagmapFindKey(ctx, tag);
+	for (unsigned int i = 0; i < sizeof(searchOrder) / sizeof(searchOrder[0]); i++) {
+		struct tagentry* current = tagmapFindKey(ctx, EXIF_IFD_KEY(searchOrder[i], tag));
+		if (current != NULL) return current;
+	}
+	return NULL;
+}
+
+// tagmapClear empties the tag map of ctx and releases the segment the
+// values were in.  The arena is kept for the next file.
+static void
+tagmapClear(j_exif_ptr ctx) {
+	ctx->numEntries = 0;
+	ctx->maxEntries = 0;
+	ctx->numMisses = 0;
+	freeMem(ctx->moreEntries);
+	ctx->moreEntries = NULL;
+	ctx->arena.used = 0;
+#ifdef USE_MMAP
+	if (ctx->map != NULL) munmap(ctx->map, ctx->mapSize);
+#endif
+	ctx->map = NULL;
+	ctx->data = NULL;
+	ctx->length = 0;
+}
+
+// captureClear forgets the metadata segments captured from the last file.
+// The metadata buffer is kept for the next file.
+static void
+captureClear(j_exif_ptr ctx) {
+	if (ctx->iccChunks > 0) memset(ctx->iccChunk, 0, sizeof(ctx->iccChunk));
+	ctx->iccChunks = 0;
+	ctx->xmp.size = ctx->mpf.size = ctx->icc.size = 0;
+	ctx->metaUsed = 0;
+	ctx->metaViews = FALSE;
+}
+
+// tagmapFree_r also forgets any segment whose read was suspended, so the
+// context can be used for the next file even if the last one was abandoned.
+GLOBAL(void)
+tagmapFree_r(j_exif_ptr ctx) {
+	tagmapClear(ctx);
+	captureClear(ctx);
+	ctx->reader.length = 0;
+	ctx->reader.data = NULL;
+	ctx->bytesRead = 0;
+}
+
+// tagmapFree also gives the arena and hash table memory back.
+GLOBAL(void)
+tagmapFree() {
+	tagmapFree_r(&default_context);
+	freeMem(default_context.arena.base);
+	default_context.arena.base = NULL;
+	default_context.arena.size = 0;
+	freeMem(default_context.hash);
+	default_context.hash = NULL;
+	default_context.hashCapacity = 0;
+	freeMem(default_context.meta);
+	default_context.meta = NULL;
+	default_context.metaSize = 0;
+}
+
+// exifCreate allocates an empty context; exifDestroy frees it and its tags.
+GLOBAL(j_exif_ptr)
+exifCreate(void) {
+	j_exif_ptr ctx = (j_exif_ptr)allocMem(sizeof(struct exif_context));
+	if (ctx == NULL) return NULL;
+	memset(ctx, 0, sizeof(struct exif_context));
+	STAT_ADD(ctx, allocations, 1);
+	STAT_ADD(ctx, bytesAllocated, sizeof(struct exif_context));
+	return ctx;
+}
+
+GLOBAL(void)
+exifDestroy(j_exif_ptr ctx) {
+	if (ctx == NULL) return;
+	tagmapFree_r(ctx);
+	freeMem(ctx->arena.base);
+	freeMem(ctx->hash);
+	freeMem(ctx->meta);
+	freeMem(ctx);
+}
+
+// exifSetAllocator makes the extension use allocFn and freeFn instead of
+// malloc and free, for example to count allocations.  NULL restores the
+// default.  It must be called before any memory is allocated.
+GLOBAL(void)
+exifSetAllocator(void* (*allocFn)(size_t), void (*freeFn)(void*)) {
+	allocMem = allocFn != NULL ? allocFn : malloc;
+	freeMem = freeFn != NULL ? freeFn : free;
+}
+
+GLOBAL(void*)
+exifAlloc(size_t size) {
+	return allocMem(size);
+}
+
+GLOBAL(void)
+exifFree(void* p) {
+	freeMem(p);
+}
+
+// exifBytesCopied_r returns the number of bytes ctx has copied out of the
+// files read into it since it was created.
+GLOBAL(uint64_t)
+exifBytesCopied_r(j_exif_ptr ctx) {
+	return ctx->bytesCopied;
+}
+
+GLOBAL(uint64_t)
+exifBytesRead_r(j_exif_ptr ctx) {
+	return ctx->bytesRead;
+}
+
+GLOBAL(boolean)
+exifStatsCollect_r(j_exif_ptr ctx, struct exif_stats* stats) {
+#ifdef EXIF_STATS
+	// the struct is all counters, so it can be summed as an array
+	const uint64_t* from = (const uint64_t*)&ctx->stats;
+	uint64_t* to = (uint64_t*)stats;
+	for (size_t i = 0; i < sizeof(struct exif_stats) / sizeof(uint64_t); i++) to[i] += from[i];
+	return TRUE;
+#else
+	(void)ctx;
+	(void)stats;
+	return FALSE;
+#endif
+}
+
+GLOBAL(void)
+exifStatsReset_r(j_exif_ptr ctx) {
+#ifdef EXIF_STATS
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+#else
+	(void)ctx;
+#endif
+}
+
+GLOBAL(boolean)
+exifStatsCollect(struct exif_stats* stats) {
+	return exifStatsCollect_r(&default_context, stats);
+}
+
+GLOBAL(void)
+exifStatsReset(void) {
+	exifStatsReset_r(&default_context);
+}
+
+GLOBAL(void)
+exifStatsPrint(const struct exif_stats* stats) {
+	static const char* ifdNames[] = { "", "IFD0", "Exif", "GPS", "IFD1" };
+	static const char* lookupNames[EXIF_LOOKUP_COUNT] = { "ASCII", "UInt", "Int", "Rational", "Blob", "Info", "Fields", "Raw" };
+	printf("APP1 segments %llu, not EXIF %llu\n",
+		(unsigned long long)stats->app1Segments, (unsigned long long)stats->app1Skipped);
+	printf("EXIF segments %llu, rejected %llu, %llu bytes\n", (unsigned long long)stats->exifSegments,
+		(unsigned long long)stats->rejectedSegments, (unsigned long long)stats->bytesIngested);
+	printf("parse time %.3f ms", stats->parseNanoseconds / 1e6);
+	if (stats->exifSegments > 0) printf(", %.0f ns per segment", (double)stats->parseNanoseconds / stats->exifSegments);
+	printf("\nallocations %llu, %llu bytes\n",
+		(unsigned long long)stats->allocations, (unsigned long long)stats->bytesAllocated);
+	printf("tags stored:");
+	for (int i = EXIF_IFD_0; i <= EXIF_IFD_1; i++) printf(" %s %llu", ifdNames[i], (unsigned long long)stats->tagsStored[i]);
+	printf("\nlookups:");
+	for (int i = 0; i < EXIF_LOOKUP_COUNT; i++) printf(" %s %llu", lookupNames[i], (unsigned long long)stats->lookups[i]);
+	printf("\n");
+}
+
+static void tagmapLoadAll(j_exif_ptr ctx);
+
+// tagmapPrint_r, prints all the IFD data in the tag map of ctx, the last
+// parsed entry first.
+GLOBAL(boolean)
+tagmapPrint_r(j_exif_ptr ctx) {
+	tagmapLoadAll(ctx);
+	for (uint32_t n = ctx->numEntries; n-- > 0; ) {
+		struct tagentry* current = &ctx->entries[n];
+		uint32_t key = EXIF_IFD_KEY(current->ifd, current->tag);
+		// big enough for count values of any type plus a terminating 0
+		void* vals = allocMem(current->count * sizeof(double) + 1);
+		if (vals == NULL) return FALSE;
+		STAT_ADD(ctx, allocations, 1);
+		STAT_ADD(ctx, bytesAllocated, current->count * sizeof(double) + 1);
+		char* avals = (char*)vals;
+		uint32_t* uivals = (uint32_t*)vals;
+		int32_t* ivals = (int32_t*)vals;
+		double* dvals = (double*)vals;
+		printf("%04x %2x %04x, ", current->tag, current->type, current->count);
+		if (current->type == TIFF_TYPE_BYTE || current->type == TIFF_TYPE_SHORT ||
+			current->type == TIFF_TYPE_LONG || current->type == TIFF_TYPE_UNDEFINED) {
+			int cnt = exifUIntData_r(ctx, key, uivals);
+			for (int i = 0; i < cnt; i++) printf("%8d ", uivals[i]);
+		}
+		if (current->type == TIFF_TYPE_SLONG) {
+			int cnt = exifIntData_r(ctx, key, ivals);
+			for (int i = 0; i < cnt; i++) printf("%8d ", ivals[i]);
+		}
+		if (current->type == TIFF_TYPE_ASCII) {
+			avals[0] = 0;
+			avals[current->count] = 0;
+			exifASCIIData_r(ctx, key, avals);
+			printf("%s ", avals);
+		}
+		if (current->type == TIFF_TYPE_RATIONAL || current->type == TIFF_TYPE_SRATIONAL) {
+			int cnt = exifRationalData_r(ctx, key, dvals);
+			for (int i = 0; i < cnt; i++) printf("%lf ", dvals[i]);
+		}
+		freeMem(vals);
+		printf("\n");
+
+		/*
+		printf("% 04x %2x %04x, ", current->tag, current->type, current->count);
+		uint32_t numBytes = current->count * typeSize[current->type];
+		for (int i = 0; i < numBytes; i++) printf("% 02x ", ctx->data[current->offset + i]);
+		printf("\n");
+		*/
+	}
+	return TRUE;
+}
+
+GLOBAL(boolean)
+tagmapPrint() {
+	return tagmapPrint_r(&default_context);
+}
+
+
+// addIFDEntry adds the 12 byte IFD entry at data[offset] of IFD ifd to the tag map.
+// Entries with an unknown type or a value outside of the segment are skipped,
+// and so are the tags that are not in the interest set of ctx.  Returns
+// FALSE if the tag map couldn't take the entry.
+static boolean
+addIFDEntry(j_exif_ptr ctx, const uint8_t* data, int32_t length, uint32_t offset, uint32_t ifd) {
+	uint32_t tagnum, type, count;
+	uint32_t dataOffset;
+
+	tagnum = get16(ctx, data + offset);
+	if (!interesting(ctx, ifd, tagnum)) return TRUE;
+	type = get16(ctx, data + offset + 2);
+	count = get32(ctx, data + offset + 4);
+	if (type >= sizeof(typeSize) / sizeof(typeSize[0]) || typeSize[type] == 0) return TRUE;
+	if (count > (uint32_t)length) return TRUE;  // can't fit in the segment
+	uint32_t numBytes = count * typeSize[type];
+	if (numBytes <= 4) return tagmapAdd(ctx, ifd, tagnum, type, count, &(data[offset + 8]));
+	dataOffset = get32(ctx, data + offset + 8);
+	dataOffset += 6;  // offset to the beginning of the TIFF data field.
+	if (dataOffset > (uint32_t)length || numBytes > (uint32_t)length - dataOffset) return TRUE;
+	return tagmapAdd(ctx, ifd, tagnum, type, count, (data + dataOffset));
+}
+
+// proocess_subIFD_tags adds the entries of the IFD whose TIFF offset is
+// pointer.  As in lazy parsing, an IFD outside the segment has no entries
+// and the entries past its end are left out.  Returns FALSE only if the
+// tag map couldn't take an entry.
+static boolean
+proocess_subIFD_tags(j_exif_ptr ctx, const uint8_t* data, int32_t length, uint32_t pointer, uint32_t ifd) {
+
+	uint32_t number_of_tags;
+	uint32_t offset = pointer + 6;  // tiff header starts at data[6]
+
+	/* Get the number of directory entries contained in this SubIFD */
+	if (offset < 14 || offset > (uint32_t)length - 2) return TRUE;
+	number_of_tags = get16(ctx, data + offset);
+	offset += 2;
+	if (number_of_tags > ((uint32_t)length - offset) / 12) number_of_tags = ((uint32_t)length - offset) / 12;
+
+	/* Add all the entries of this SubIFD */
+	for (; number_of_tags > 0; number_of_tags--, offset += 12) {
+		if (!addIFDEntry(ctx, data, length, offset, ifd)) return FALSE;
+	}
+	return TRUE;
+}
+
+// laterEntry tells if one of the next count entries of an IFD, after the
+// one at data[offset], is for tag too.
+static boolean
+laterEntry(j_exif_ptr ctx, const uint8_t* data, int32_t length, uint32_t offset, uint32_t count, uint32_t tag) {
+	for (; count > 0; count--) {
+		offset += 12;
+		if (offset > (uint32_t)length - 12) return FALSE;
+		if (get16(ctx, data + offset) == tag) return TRUE;
+	}
+	return FALSE;
+}
+
+
+// rejected counts a malformed EXIF segment, which is still reported as
+// found, with whatever tags were read before the error.
+static boolean
+rejected(j_exif_ptr ctx) {
+	STAT_ADD(ctx, rejectedSegments, 1);
+	return TRUE;
+}
+
+// decode_exif_segment parses the payload of an APP1 segment of length bytes
+// into ctx.  If it doesn't start with the Exif header nothing is parsed, as
+// it may be other APP1 data like XMP.  Returns TRUE if EXIF data was found,
+// in which case the tags point into data and the caller must keep it alive
+// until the tags are freed.  The caller clears ctx and prepares its arena
+// for the segment first.
+LOCAL(boolean)
+decode_exif_segment(j_exif_ptr ctx, const uint8_t* data, int32_t length) {
+	uint32_t numberOfTags, tagnum;
+	uint32_t firstOffset;
+
+	/* Check to see that this is EXIF data */
+	if (length < 14 || 0 != memcmp(data, "Exif", 5)) return FALSE;
+
+	ctx->data = data;
+	ctx->length = length;
+
+	/* Discover byte order */
+	if (data[6] == 0x49 && data[7] == 0x49)
+		ctx->bigEndian = FALSE;  // Intel byte order.
+	else if (data[6] == 0x4D && data[7] == 0x4D)
+		ctx->bigEndian = TRUE;   // Motorola byte order.
+	else
+		return rejected(ctx);  // Expected endian code was not found
+
+	/* Check Tag Mark */
+	uint32_t tagMark = get16(ctx, data + 8);
+	if (tagMark != 0x2A) return rejected(ctx);
+
+	/* Get first IFD offset (offset to IFD0) */
+
+	firstOffset = get32(ctx, data + 10);
+	if (firstOffset > (uint32_t)length - 8) return rejected(ctx);  // checked before adding 6 so it can't wrap
+	firstOffset += 6; // account for Exif strng at the begining of the buffer;
+	if (firstOffset < 14) return rejected(ctx);
+
+	/* Get the number of directory entries contained in this IFD */
+
+	numberOfTags = get16(ctx, data + firstOffset);
+	if (numberOfTags == 0) return TRUE;
+	firstOffset += 2;
+
+	// in lazy mode the entries are decoded when they are looked up
+	ctx->ifds[EXIF_IFD_0].offset = firstOffset;
+	ctx->ifds[EXIF_IFD_0].count = numberOfTags;
+	if (ctx->options & EXIF_OPTION_LAZY) return TRUE;
+
+	/* Search for ExifSubIFD offset Tag in IFD0 */
+	for (;;) {
+		if (firstOffset > (uint32_t)length - 12) return rejected(ctx); /* check end of data segment */
+		/* Get Tag number */
+		tagnum = get16(ctx, data + firstOffset);
+		if (tagnum == 0x8769 || tagnum == 0x8825) { /* found ExifSubIFD or GPSSubIDF offset Tag */
+			// only the last pointer counts, as for any repeated tag
+			if (!laterEntry(ctx, data, length, firstOffset, numberOfTags - 1, tagnum) &&
+				!proocess_subIFD_tags(ctx, data, length, get32(ctx, data + firstOffset + 8),
+					tagnum == 0x8769 ? EXIF_IFD_EXIF : EXIF_IFD_GPS)) return rejected(ctx);
+		}	else { // Otherwise addd the IDF to the tagmap.
+			if (!addIFDEntry(ctx, data, length, firstOffset, EXIF_IFD_0)) return rejected(ctx);
+		}
+		if (--numberOfTags == 0) { break; }
+		firstOffset += 12;
+	}
+
+	/* IFD0 ends with the offset of IFD1, which describes the thumbnail */
+	firstOffset += 12;
+	if (firstOffset > (uint32_t)length - 4) return TRUE;
+	uint32_t next = get32(ctx, data + firstOffset);
+	if (next != 0 && !proocess_subIFD_tags(ctx, data, length, next, EXIF_IFD_1)) return rejected(ctx);
+	return TRUE;
+}
+
+#ifdef EXIF_STATS
+// statsClock returns a time in nanoseconds to measure intervals with.
+static uint64_t
+statsClock(void) {
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+	return (uint64_t)clock() * (1000000000u / CLOCKS_PER_SEC);
+#endif
+}
+#endif
+
+// parse_exif_segment is decode_exif_segment, counted in the statistics of ctx.
+LOCAL(boolean)
+parse_exif_segment(j_exif_ptr ctx, const uint8_t* data, int32_t length) {
+#ifdef EXIF_STATS
+	uint64_t start = statsClock();
+	boolean found = decode_exif_segment(ctx, data, length);
+	ctx->stats.app1Segments++;
+	if (found) {
+		ctx->stats.exifSegments++;
+		ctx->stats.bytesIngested += (uint64_t)length;
+		ctx->stats.parseNanoseconds += statsClock() - start;
+	} else {
+		ctx->stats.app1Skipped++;
+	}
+	return found;
+#else
+	return decode_exif_segment(ctx, data, length);
+#endif
+}
+
+
+// This section implements lazy parsing.  With EXIF_OPTION_LAZY set, reading
+// the segment only records where IFD0 is.  An entry is decoded the first
+// time it is looked up and is then kept in the tag map like any other.  The
+// first LAZY_MISSES tags that are not in their IFD are remembered apart from
+// the entries, so the IFD isn't searched for them again.
+
+static uint32_t findRawEntry(j_exif_ptr ctx, uint32_t ifd, uint32_t tag, uint32_t before);
+
+// locateIFD finds the entries of ifd in the segment and returns the number
+// of entries.  The position of IFD0 is recorded by parse_exif_segment, the
+// Exif and GPS IFDs are found through their pointer tags in IFD0 and IFD1
+// through the link that follows the entries of IFD0.
+static uint32_t
+locateIFD(j_exif_ptr ctx, uint32_t ifd) {
+	struct ifdinfo* info = &ctx->ifds[ifd];
+	const uint8_t* data = ctx->data;
+	if (info->located) return info->count;
+	info->located = TRUE;
+	if (ifd != EXIF_IFD_0) {
+		uint32_t offset;
+		if (ifd == EXIF_IFD_1) {
+			uint32_t link = ctx->ifds[EXIF_IFD_0].offset;
+			if (link < 16 || link > (uint32_t)ctx->length) return 0;
+			link += 12 * get16(ctx, data + link - 2);
+			if (link > (uint32_t)ctx->length - 4) return 0;
+			offset = get32(ctx, data + link);
+			if (offset == 0) return 0;
+		} else {
+			uint32_t pointer = findRawEntry(ctx, EXIF_IFD_0, ifd == EXIF_IFD_EXIF ? 0x8769 : 0x8825, 0);
+			if (pointer == 0) return 0;
+			offset = get32(ctx, data + pointer + 8);
+		}
+		offset += 6;  // tiff header starts at data[6]
+		if (offset < 14 || offset > (uint32_t)ctx->length - 2) return 0;
+		info->offset = offset + 2;
+		info->count = get16(ctx, data + offset);
+	}
+	// only count the entries that are inside the segment
+	if (info->offset > (uint32_t)ctx->length) info->count = 0;
+	else if (info->count > ((uint32_t)ctx->length - info->offset) / 12)
+		info->count = ((uint32_t)ctx->length - info->offset) / 12;
+	info->sorted = TRUE;
+	for (uint32_t i = 1; i < info->count && info->sorted; i++) {
+		const uint8_t* e = data + info->offset + 12 * i;
+		info->sorted = get16(ctx, e) > get16(ctx, e - 12);
+	}
+	return info->count;
+}
+
+// findRawEntry returns the offset of the last IFD entry for tag in the
+// segment that is before the entry at offset before, or anywhere in the IFD
+// if before is 0.  Returns 0 if ifd has no such entry.  A sorted IFD has one
+// entry for a tag at most.
+static uint32_t
+findRawEntry(j_exif_ptr ctx, uint32_t ifd, uint32_t tag, uint32_t before) {
+	const uint8_t* data = ctx->data;
+	uint32_t count = locateIFD(ctx, ifd);
+	uint32_t first = ctx->ifds[ifd].offset;
+	if (ctx->ifds[ifd].sorted) {
+		if (before != 0) return 0;
+		uint32_t lo = 0, hi = count;
+		while (lo < hi) {
+			uint32_t mid = (lo + hi) / 2;
+			uint32_t offset = first + 12 * mid;
+			uint32_t midTag = get16(ctx, data + offset);
+			if (midTag == tag) return offset;
+			if (midTag < tag) lo = mid + 1;
+			else hi = mid;
+		}
+		return 0;
+	}
+	if (before != 0) count = (before - first) / 12;
+	while (count-- > 0) {
+		uint32_t offset = first + 12 * count;
+		if (get16(ctx, data + offset) == tag) return offset;
+	}
+	return 0;
+}
+
+// lazyFind decodes the entry for key from the segment and adds it to the
+// tag map.
+static struct tagentry*
+lazyFind(j_exif_ptr ctx, uint32_t key) {
+	uint32_t ifd = key >> 16;
+	uint32_t tag = key & 0xFFFF;
+	uint32_t offset = 0;
+	uint32_t numEntries = ctx->numEntries;
+
+	if (ctx->data == NULL || ifd < EXIF_IFD_0 || ifd > EXIF_IFD_1) return NULL;
+	if (!interesting(ctx, ifd, tag)) return NULL;
+	for (uint32_t i = 0; i < ctx->numMisses; i++) {
+		if (ctx->misses[i] == key) return NULL;
+	}
+	// the SubIFD pointers are not tags of their own
+	if (ifd != EXIF_IFD_0 || (tag != 0x8769 && tag != 0x8825))
+		offset = findRawEntry(ctx, ifd, tag, 0);
+	// the last entry for a tag that can be read wins, as in eager parsing
+	while (offset != 0) {
+		if (!addIFDEntry(ctx, ctx->data, ctx->length, offset, ifd)) return NULL;
+		if (ctx->numEntries != numEntries) return &ctx->entries[numEntries];
+		offset = findRawEntry(ctx, ifd, tag, offset);
+	}
+	if (ctx->numMisses < LAZY_MISSES) ctx->misses[ctx->numMisses++] = key;  // remember that it is not there
+	return NULL;
+}
+
+// tagmapLoadAll decodes all the entries that lazy parsing hasn't decoded yet.
+static void
+tagmapLoadAll(j_exif_ptr ctx) {
+	if (!(ctx->options & EXIF_OPTION_LAZY) || ctx->data == NULL) return;
+	for (unsigned int i = 0; i < sizeof(searchOrder) / sizeof(searchOrder[0]); i++) {
+		uint32_t ifd = searchOrder[i];
+		uint32_t count = locateIFD(ctx, ifd);
+		uint32_t offset = ctx->ifds[ifd].offset;
+		for (uint32_t n = 0; n < count; n++, offset += 12) {
+			uint32_t tag = get16(ctx, ctx->data + offset);
+			if (ifd == EXIF_IFD_0 && (tag == 0x8769 || tag == 0x8825)) continue;
+			// the entries are added in order, so a repeated tag ends up with
+			// its last entry, and the ones already looked up are written over
+			// with the same values
+			if (!addIFDEntry(ctx, ctx->data, ctx->length, offset, ifd)) return;
+		}
+	}
+}
+
+// exifSetOptions sets the EXIF_OPTION_ flags of ctx.
+GLOBAL(void)
+exifSetOptions(j_exif_ptr ctx, unsigned int options) {
+	ctx->options = options;
+}
+
+// exifInterestCreate sets the bits of an interest set.  A tag without an
+// IFD is kept in all of them.
+GLOBAL(j_exif_interest)
+exifInterestCreate(const uint32_t* tags, int numTags) {
+	if (tags == NULL || numTags < 0) return NULL;
+	struct exif_interest* set = (struct exif_interest*)allocMem(sizeof(struct exif_interest));
+	if (set == NULL) return NULL;
+	memset(set, 0, sizeof(struct exif_interest));
+	for (int i = 0; i < numTags; i++) {
+		uint32_t ifd = tags[i] >> 16;
+		uint32_t tag = tags[i] & 0xFFFF;
+		for (uint32_t n = EXIF_IFD_0; n <= EXIF_IFD_1; n++) {
+			if (ifd != EXIF_IFD_ANY && ifd != n) continue;
+			uint8_t* byte = &set->bits[n - 1][tag >> 3];
+			if (!(*byte >> (tag & 7) & 1)) set->count++;
+			*byte |= (uint8_t)(1 << (tag & 7));
+		}
+	}
+	return set;
+}
+
+GLOBAL(void)
+exifInterestDestroy(j_exif_interest set) {
+	freeMem(set);
+}
+
+GLOBAL(void)
+exifSetInterest_r(j_exif_ptr ctx, j_exif_interest set) {
+	ctx->interest = set;
+}
+
+GLOBAL(void)
+exifSetBlobLimit_r(j_exif_ptr ctx, uint32_t maxBytes) {
+	ctx->blobLimit = maxBytes;
+}
+
+// exifTagList_r stores the keys of the tags in ctx in keys.
+GLOBAL(int)
+exifTagList_r(j_exif_ptr ctx, uint32_t* keys, int maxKeys) {
+	int n = 0;
+	tagmapLoadAll(ctx);
+	for (uint32_t i = 0; i < ctx->numEntries; i++) {
+		struct tagentry* e = &ctx->entries[i];
+		if (keys != NULL && n < maxKeys) keys[n] = EXIF_IFD_KEY(e->ifd, e->tag);
+		n++;
+	}
+	return n;
+}
+
+// exifTagInfo_r returns the TIFF type and the count of a tag.
+GLOBAL(boolean)
+exifTagInfo_r(j_exif_ptr ctx, uint32_t tag, uint16_t* type, uint32_t* count) {
+	STAT_ADD(ctx, lookups[EXIF_LOOKUP_INFO], 1);
+	struct tagentry* current = tagmapFind(ctx, tag);
+	if (current == NULL) return FALSE;
+	if (type != NULL) *type = current->type;
+	if (count != NULL) *count = current->count;
+	return TRUE;
+}
+
+// exifTagData_r and exifLoadTags_r let jdexifcache.c store the tags of a
+// file and put them back into a context later.
+GLOBAL(uint32_t)
+exifTagData_r(j_exif_ptr ctx, const struct tagentry** entries,
+		const uint8_t** data, int32_t* length, boolean* bigEndian) {
+	tagmapLoadAll(ctx);
+	*entries = ctx->entries;
+	*data = ctx->data;
+	*length = ctx->length;
+	*bigEndian = ctx->bigEndian;
+	return ctx->data != NULL ? ctx->numEntries : 0;
+}
+
+GLOBAL(boolean)
+exifHasInterest_r(j_exif_ptr ctx) {
+	return ctx->interest != NULL;
+}
+
+GLOBAL(boolean)
+exifLoadTags_r(j_exif_ptr ctx, const struct tagentry* entries, uint32_t numEntries,
+		const uint8_t* data, int32_t length, boolean bigEndian) {
+	tagmapFree_r(ctx);
+	if (data == NULL || length <= 0) return TRUE;
+	uint8_t* segment = arenaPrepare(ctx, length, TRUE);
+	if (segment == NULL) return FALSE;
+	memcpy(segment, data, length);
+	ctx->bytesCopied += length;
+	ctx->data = segment;
+	ctx->length = length;
+	ctx->bigEndian = bigEndian;
+	// all the entries are loaded, so lazy lookups have nothing to search
+	for (unsigned int i = 0; i <= EXIF_IFD_1; i++) ctx->ifds[i].located = TRUE;
+	for (uint32_t i = 0; i < numEntries; i++) {
+		const struct tagentry* e = &entries[i];
+		if (e->ifd < EXIF_IFD_0 || e->ifd > EXIF_IFD_1 || !interesting(ctx, e->ifd, e->tag)) continue;
+		if (e->type >= sizeof(typeSize) / sizeof(typeSize[0]) || typeSize[e->type] == 0) continue;
+		if (e->offset > (uint32_t)length || e->count > (uint32_t)length ||
+			e->count * typeSize[e->type] > (uint32_t)length - e->offset) continue;
+		if (!tagmapAdd(ctx, e->ifd, e->tag, e->type, e->count, segment + e->offset)) return FALSE;
+	}
+	return TRUE;
+}
+
+
+// This section keeps the other metadata segments of a file with its tags:
+// XMP packets in APP1, ICC profiles, which may be split over several APP2
+// segments, and the MPF index of multi-picture files in APP2.  Each is only
+// kept when its EXIF_OPTION_CAPTURE_ option is set.
+
+#define XMP_SIGNATURE "http://ns.adobe.com/xap/1.0/"  // and a 0
+#define ICC_SIGNATURE "ICC_PROFILE"                   // and a 0
+#define MPF_SIGNATURE "MPF"                           // and a 0
+
+// captureKind returns the EXIF_METADATA_ kind of a segment of ctx with marker
+// that starts with the n bytes at head, and the length of its signature, or
+// 0 if ctx doesn't keep it.
+static int
+captureKind(j_exif_ptr ctx, int marker, const uint8_t* head, size_t n, size_t* skip) {
+	if (marker == JPEG_APP0 + 1 && (ctx->options & EXIF_OPTION_CAPTURE_XMP) &&
+		n >= sizeof(XMP_SIGNATURE) && 0 == memcmp(head, XMP_SIGNATURE, sizeof(XMP_SIGNATURE))) {
+		*skip = sizeof(XMP_SIGNATURE);
+		return EXIF_METADATA_XMP;
+	}
+	// an ICC chunk has its sequence number and the number of chunks after the signature
+	if (marker == JPEG_APP0 + 2 && (ctx->options & EXIF_OPTION_CAPTURE_ICC) &&
+		n >= sizeof(ICC_SIGNATURE) + 2 && 0 == memcmp(head, ICC_SIGNATURE, sizeof(ICC_SIGNATURE))) {
+		*skip = sizeof(ICC_SIGNATURE) + 2;
+		return EXIF_METADATA_ICC;
+	}
+	if (marker == JPEG_APP0 + 2 && (ctx->options & EXIF_OPTION_CAPTURE_MPF) &&
+		n >= sizeof(MPF_SIGNATURE) && 0 == memcmp(head, MPF_SIGNATURE, sizeof(MPF_SIGNATURE))) {
+		*skip = sizeof(MPF_SIGNATURE);
+		return EXIF_METADATA_MPF;
+	}
+	return 0;
+}
+
+// captureReserve makes room for n more bytes in the metadata buffer of ctx
+// and returns where they go, or NULL if out of memory.  Captures are kept by
+// offset, so the buffer may move when it grows.
+static uint8_t*
+captureReserve(j_exif_ptr ctx, size_t n) {
+	if (n > ctx->metaSize - ctx->metaUsed) {
+		size_t size = ctx->metaSize > 0 ? ctx->metaSize : 4096;
+		while (size - ctx->metaUsed < n) size *= 2;
+		uint8_t* meta = (uint8_t*)allocMem(size);
+		if (meta == NULL) return NULL;
+		STAT_ADD(ctx, allocations, 1);
+		STAT_ADD(ctx, bytesAllocated, size);
+		if (ctx->metaUsed > 0) memcpy(meta, ctx->meta, ctx->metaUsed);
+		freeMem(ctx->meta);
+		ctx->meta = meta;
+		ctx->metaSize = size;
+	}
+	ctx->metaUsed += n;
+	return ctx->meta + ctx->metaUsed - n;
+}
+
+// captureAdd records a segment of size bytes of the given kind.  It is at
+// view in the input, or at offset in the metadata buffer if view is NULL.
+// A later XMP or MPF segment replaces an earlier one; ICC chunks are kept
+// by their sequence number until the profile is asked for.
+static void
+captureAdd(j_exif_ptr ctx, int kind, const uint8_t* view, size_t offset, size_t size) {
+	const uint8_t* data = view != NULL ? view : ctx->meta + offset;
+	struct capture* c;
+	size_t skip = 0;
+	if (captureKind(ctx, kind == EXIF_METADATA_XMP ? JPEG_APP0 + 1 : JPEG_APP0 + 2, data, size, &skip) != kind) return;
+	if (kind == EXIF_METADATA_ICC) {
+		uint32_t sequence = data[skip - 2];
+		uint32_t chunks = data[skip - 1];
+		if (sequence == 0 || sequence > chunks) return;
+		if (ctx->iccChunks != 0 && ctx->iccChunks != chunks) return;  // of another profile
+		ctx->iccChunks = chunks;
+		c = &ctx->iccChunk[sequence];
+	} else {
+		c = kind == EXIF_METADATA_XMP ? &ctx->xmp : &ctx->mpf;
+	}
+	c->view = view != NULL ? view + skip : NULL;
+	c->offset = offset + skip;
+	c->size = size - skip;
+	if (view != NULL) ctx->metaViews = TRUE;
+}
+
+// captureData returns where the bytes of c are.
+#define captureData(ctx, c)  ((c)->view != NULL ? (c)->view : (ctx)->meta + (c)->offset)
+
+// exifMetadata_r puts the chunks of an ICC profile together the first time
+// it is asked for.
+GLOBAL(boolean)
+exifMetadata_r(j_exif_ptr ctx, int kind, const uint8_t** data, size_t* size) {
+	struct capture* c = NULL;
+	if (kind == EXIF_METADATA_XMP) c = &ctx->xmp;
+	else if (kind == EXIF_METADATA_MPF) c = &ctx->mpf;
+	else if (kind == EXIF_METADATA_ICC && ctx->iccChunks == 1) c = &ctx->iccChunk[1];
+	else if (kind == EXIF_METADATA_ICC && ctx->iccChunks > 1) {
+		c = &ctx->icc;
+		if (c->size == 0) {
+			size_t total = 0;
+			for (uint32_t i = 1; i <= ctx->iccChunks; i++) {
+				if (ctx->iccChunk[i].size == 0) return FALSE;  // a chunk is missing
+				total += ctx->iccChunk[i].size;
+			}
+			uint8_t* profile = captureReserve(ctx, total);
+			if (profile == NULL) return FALSE;
+			c->view = NULL;
+			c->offset = (size_t)(profile - ctx->meta);
+			for (uint32_t i = 1; i <= ctx->iccChunks; i++) {
+				memcpy(profile, captureData(ctx, &ctx->iccChunk[i]), ctx->iccChunk[i].size);
+				profile += ctx->iccChunk[i].size;
+			}
+			c->size = total;
+		}
+	}
+	if (c == NULL || c->size == 0) return FALSE;
+	*data = captureData(ctx, c);
+	*size = c->size;
+	return TRUE;
+}
+
+GLOBAL(boolean)
+exifCapturesMetadata_r(j_exif_ptr ctx) {
+	return (ctx->options & (EXIF_OPTION_CAPTURE_XMP | EXIF_OPTION_CAPTURE_ICC | EXIF_OPTION_CAPTURE_MPF)) != 0;
+}
+
+
+// read_exif_segment reads the APPn segment at the current position of the
+// source manager and parses any EXIF data in it into ctx, or keeps it if it
+// is metadata ctx captures.  The segment is copied in pieces as large as the
+// source manager has at hand.  If the source suspends, FALSE is returned
+// with the progress kept in ctx->reader, and the next call resumes where
+// this one stopped.
+LOCAL(boolean)
+read_exif_segment(j_decompress_ptr cinfo, j_exif_ptr ctx) {
+	struct segment_reader* reader = &ctx->reader;
+	int32_t length, bytesRead;
+	
+	INPUT_VARS(cinfo);
+
+	if (reader->length == 0) {
+		// read the size of the data for marker APP1
+		INPUT_2BYTES(cinfo, length, return FALSE);
+		length -= 2;
+		INPUT_SYNC(cinfo);
+
+		/* an empty segment has nothing to read */
+		if (length <= 0) return TRUE;
+		reader->length = length;
+		reader->bytesRead = 0;
+		reader->data = NULL;
+	}
+	length = reader->length;
+	bytesRead = reader->bytesRead;
+	int32_t headerLength = length < CAPTURE_HEADER ? length : CAPTURE_HEADER;
+
+	for (;;) {
+		// once the header is in, decide where the rest of the segment goes.
+		// Other segments are skipped without copying them anywhere.
+		if (reader->data == NULL && bytesRead == headerLength) {
+			size_t skip;
+			reader->kind = captureKind(ctx, cinfo->unread_marker, reader->header, headerLength, &skip);
+			if (reader->kind != 0) {
+				reader->data = captureReserve(ctx, length);
+				reader->offset = reader->data != NULL ? (size_t)(reader->data - ctx->meta) : 0;
+			} else if (cinfo->unread_marker == JPEG_APP0 + 1 && headerLength >= 6 &&
+				0 == memcmp(reader->header, "Exif", 5)) {
+				// if there is exif data from a previous file, clear it.
+				tagmapClear(ctx);
+				reader->data = arenaPrepare(ctx, length, TRUE);
+			}
+			if (reader->kind == EXIF_METADATA_XMP) STAT_ADD(ctx, app1Segments, 1);
+			if (reader->data == NULL && cinfo->unread_marker == JPEG_APP0 + 1) {
+				STAT_ADD(ctx, app1Segments, 1);
+				STAT_ADD(ctx, app1Skipped, 1);
+			}
+			if (reader->data == NULL) {
+				reader->length = 0;
+				INPUT_SYNC(cinfo);
+				if (length > bytesRead)
+					(*cinfo->src->skip_input_data) (cinfo, (long)(length - bytesRead));
+				return TRUE;
+			}
+			memcpy(reader->data, reader->header, headerLength);
+			ctx->bytesCopied += headerLength;
+		}
+		if (bytesRead == length) break;
+
+		// everything up to here is consumed, so a suspension restarts here
+		INPUT_SYNC(cinfo);
+		reader->bytesRead = bytesRead;
+		MAKE_BYTE_AVAIL(cinfo, return FALSE);
+		uint8_t* dest = reader->data != NULL ? reader->data : reader->header;
+		int32_t limit = reader->data != NULL ? length : headerLength;
+		size_t n = (size_t)(limit - bytesRead);
+		if (n > bytes_in_buffer) n = bytes_in_buffer;
+		memcpy(dest + bytesRead, next_input_byte, n);
+		next_input_byte += n;
+		bytes_in_buffer -= n;
+		bytesRead += (int32_t)n;
+		ctx->bytesCopied += n;
+	}
+	INPUT_SYNC(cinfo);
+
+	// the segment is kept in the arena for the tags
+	reader->length = 0;
+	if (reader->kind != 0) captureAdd(ctx, reader->kind, NULL, reader->offset, (size_t)length);
+	else parse_exif_segment(ctx, reader->data, length);
+	reader->data = NULL;
+	return TRUE;
+}
+
+// process_exif_parameters is the APP1 marker processor that is patched into
+// jdmarker.c.  It fills the shared default context.  It can be patched in as
+// the APP2 processor too, to capture ICC profiles and MPF data.
+boolean
+process_exif_parameters(j_decompress_ptr cinfo) {
+	return read_exif_segment(cinfo, &default_context);
+}
+
+// process_exif_parameters_r is the APP1 marker processor installed by
+// exifAttach.  It fills the context stored in cinfo->client_data.
+METHODDEF(boolean)
+process_exif_parameters_r(j_decompress_ptr cinfo) {
+	return read_exif_segment(cinfo, (j_exif_ptr)cinfo->client_data);
+}
+
+// reset_exif_markers wraps the reset of the marker reader, which
+// jpeg_read_header does before the markers of each image.  The tags and
+// captures of the last image go with it, so a decompressor that reads many
+// images into one context neither shows stale data nor keeps growing the
+// metadata buffer.
+METHODDEF(void)
+reset_exif_markers(j_decompress_ptr cinfo) {
+	j_exif_ptr ctx = (j_exif_ptr)cinfo->client_data;
+	tagmapFree_r(ctx);
+	(*ctx->resetMarkers) (cinfo);
+}
+
+// exifAttach makes cinfo parse its EXIF data into ctx.  It takes over
+// cinfo->client_data and installs the APP1 marker processor through
+// jpeg_set_marker_processor, so no change to jdmarker.c is needed for it.
+// The APP2 processor is only installed when ctx captures ICC or MPF data.
+// ctx is emptied at the start of every image cinfo reads.
+GLOBAL(void)
+exifAttach(j_decompress_ptr cinfo, j_exif_ptr ctx) {
+	tagmapFree_r(ctx);
+	if (cinfo->marker->reset_marker_reader != reset_exif_markers) {
+		ctx->resetMarkers = cinfo->marker->reset_marker_reader;
+		cinfo->marker->reset_marker_reader = reset_exif_markers;
+	} else {
+		// attached before, maybe to another context
+		ctx->resetMarkers = ((j_exif_ptr)cinfo->client_data)->resetMarkers;
+	}
+	cinfo->client_data = (void*)ctx;
+	jpeg_set_marker_processor(cinfo, JPEG_APP0 + 1, process_exif_parameters_r);
+	if (ctx->options & (EXIF_OPTION_CAPTURE_ICC | EXIF_OPTION_CAPTURE_MPF))
+		jpeg_set_marker_processor(cinfo, JPEG_APP0 + 2, process_exif_parameters_r);
+}
+
+
+// This section reads the EXIF data straight from a file or memory buffer
+// without a decompressor.  The JPEG markers are walked only up to the first
+// APP1 segment that holds EXIF data; the scan data is never reached.
+
+#define M_SOI   0xD8
+#define M_EOI   0xD9
+#define M_SOS   0xDA
+#define M_APP1  0xE1
+#define M_APP2  0xE2
+#define M_TEM   0x01
+#define M_RST0  0xD0
+#define M_RST7  0xD7
+
+// MINIMAL_READ_PREFIX is the number of bytes read first in minimal read
+// mode.  It reaches the APP1 header behind an APP0 JFIF segment.  Later
+// reads of marker headers only read the 4 bytes of marker and length.
+#ifndef MINIMAL_READ_PREFIX
+#define MINIMAL_READ_PREFIX 64
+#endif
+#if MINIMAL_READ_PREFIX < CAPTURE_HEADER
+#error "MINIMAL_READ_PREFIX must hold the header of a metadata segment"
+#endif
+
+// A marker_source reads from a memory buffer, from a stdio file, or in
+// minimal read mode with pread from a file descriptor.  In that mode buf
+// holds the size bytes of the file read last, starting at file offset
+// offset, and skipped data is never read.
+struct marker_source {
+	const uint8_t* buf; // the memory buffer when fp is NULL
+	size_t size;
+	size_t pos;
+	FILE* fp;
+	boolean positioned; // read with pread from fd
+	int fd;
+	uint64_t offset;
+	uint64_t fileSize;
+	uint64_t bytesRead;
+	uint8_t prefix[MINIMAL_READ_PREFIX];
+};
+
+#ifdef USE_MMAP
+// source_pread reads n bytes at offset into dest, and returns FALSE if it
+// can't read them all.
+LOCAL(boolean)
+source_pread(struct marker_source* src, uint8_t* dest, size_t n, uint64_t offset) {
+	while (n > 0) {
+		ssize_t got = pread(src->fd, dest, n, (off_t)offset);
+		if (got <= 0) return FALSE;
+		src->bytesRead += (uint64_t)got;
+		dest += got;
+		offset += (uint64_t)got;
+		n -= (size_t)got;
+	}
+	return TRUE;
+}
+
+// source_fill reads the next bytes of the file into the prefix buffer.
+LOCAL(boolean)
+source_fill(struct marker_source* src) {
+	uint64_t position = src->offset + src->pos;
+	size_t n = position == 0 ? MINIMAL_READ_PREFIX : 4;
+	if (position >= src->fileSize) return FALSE;
+	if (n > src->fileSize - position) n = (size_t)(src->fileSize - position);
+	src->offset = position;
+	src->pos = 0;
+	src->size = 0;
+	if (!source_pread(src, src->prefix, n, position)) return FALSE;
+	src->size = n;
+	return TRUE;
+}
+#endif
+
+// source_byte returns the next byte or -1 at the end of the input.
+LOCAL(int)
+source_byte(struct marker_source* src) {
+	if (src->fp != NULL) return getc(src->fp);
+#ifdef USE_MMAP
+	if (src->positioned && src->pos >= src->size && !source_fill(src)) return -1;
+#endif
+	if (src->pos >= src->size) return -1;
+	return src->buf[src->pos++];
+}
+
+LOCAL(boolean)
+source_skip(struct marker_source* src, size_t n) {
+	if (src->fp != NULL) return fseek(src->fp, (long)n, SEEK_CUR) == 0;
+	if (src->positioned && n > src->size - src->pos) {
+		// move past the data without reading it
+		uint64_t position = src->offset + src->pos + n;
+		if (position > src->fileSize) return FALSE;
+		src->offset = position;
+		src->pos = src->size = 0;
+		return TRUE;
+	}
+	if (n > src->size - src->pos) return FALSE;
+	src->pos += n;
+	return TRUE;
+}
+
+// source_peek returns the next n bytes of the input without moving past
+// them, or NULL if there aren't that many.  n is at most CAPTURE_HEADER.
+LOCAL(const uint8_t*)
+source_peek(struct marker_source* src, size_t n) {
+	if (src->fp != NULL) {
+		if (fread(src->prefix, 1, n, src->fp) != n || fseek(src->fp, -(long)n, SEEK_CUR) != 0) return NULL;
+		return src->prefix;
+	}
+#ifdef USE_MMAP
+	if (src->positioned && n > src->size - src->pos) {
+		uint64_t position = src->offset + src->pos;
+		if (n > src->fileSize - position) return NULL;
+		src->offset = position;
+		src->pos = src->size = 0;
+		if (!source_pread(src, src->prefix, n, position)) return NULL;
+		src->size = n;
+	}
+#endif
+	if (n > src->size - src->pos) return NULL;
+	return src->buf + src->pos;
+}
+
+// source_read copies the next n bytes of a file to dest.  In minimal read
+// mode the part that isn't in the prefix buffer yet is read with one read
+// of exactly its size.
+LOCAL(boolean)
+source_read(struct marker_source* src, uint8_t* dest, size_t n) {
+#ifdef USE_MMAP
+	if (src->positioned) {
+		size_t have = src->size - src->pos;
+		uint64_t position = src->offset + src->pos;
+		if (have > n) have = n;
+		if ((uint64_t)n > src->fileSize - position) return FALSE;
+		memcpy(dest, src->buf + src->pos, have);
+		if (n > have && !source_pread(src, dest + have, n - have, position + have)) return FALSE;
+		src->offset = position + n;
+		src->pos = src->size = 0;
+		return TRUE;
+	}
+#endif
+	return fread(dest, 1, n, src->fp) == n;
+}
+
+// source_segment returns a pointer to the next n bytes of the input, an APP1
+// segment, and prepares the arena of ctx for parsing it.  For a memory
+// buffer that points into the buffer itself, otherwise the segment is read
+// into the arena.
+LOCAL(const uint8_t*)
+source_segment(struct marker_source* src, j_exif_ptr ctx, int32_t n) {
+	if (src->fp == NULL && !src->positioned) {
+		if ((size_t)n > src->size - src->pos) return NULL;
+		if (arenaPrepare(ctx, n, FALSE) == NULL) return NULL;
+		src->pos += n;
+		return src->buf + src->pos - n;
+	}
+	uint8_t* data = arenaPrepare(ctx, n, TRUE);
+	if (data == NULL || !source_read(src, data, (size_t)n)) return NULL;
+	ctx->bytesCopied += n;
+	return data;
+}
+
+// source_capture keeps the next n bytes of the input, a metadata segment
+// of the given kind, in ctx.  A memory buffer outlives the parse, so the
+// capture points into it; a file is read into the metadata buffer.
+LOCAL(boolean)
+source_capture(struct marker_source* src, j_exif_ptr ctx, int kind, int32_t n) {
+	if (src->fp == NULL && !src->positioned) {
+		if ((size_t)n > src->size - src->pos) return FALSE;
+		captureAdd(ctx, kind, src->buf + src->pos, 0, (size_t)n);
+		src->pos += n;
+		return TRUE;
+	}
+	uint8_t* data = captureReserve(ctx, (size_t)n);
+	if (data == NULL || !source_read(src, data, (size_t)n)) return FALSE;
+	ctx->bytesCopied += n;
+	captureAdd(ctx, kind, NULL, (size_t)(data - ctx->meta), (size_t)n);
+	return TRUE;
+}
+
+// source_at_exif tells if the APP1 segment of length bytes at the current
+// position starts with the Exif header.  Only the header is looked at, so
+// XMP and other APP1 segments can be skipped without reading them.
+LOCAL(boolean)
+source_at_exif(struct marker_source* src, int32_t length) {
+	if (length < 14) return FALSE;  // too short for decode_exif_segment
+	const uint8_t* head = source_peek(src, 6);
+	return head != NULL && 0 == memcmp(head, "Exif", 5);
+}
+
+// scan_for_exif parses the first EXIF APP1 segment of a JPEG file into ctx.
+// It stops there, or when ctx captures metadata segments, at SOS or EOI.
+// ctx must have been cleared by the caller.  Returns 1 if EXIF data was
+// found, 0 if not and -1 if the input doesn't start with an SOI marker.
+LOCAL(int)
+scan_for_exif(j_exif_ptr ctx, struct marker_source* src) {
+	int marker, hi, lo;
+	int32_t length;
+	int found = 0;
+	boolean capturing = exifCapturesMetadata_r(ctx);
+
+	if (source_byte(src) != 0xFF || source_byte(src) != M_SOI) return -1;
+	for (;;) {
+		if (source_byte(src) != 0xFF) return found;  // lost sync with the markers
+		do {
+			marker = source_byte(src);
+		} while (marker == 0xFF);  // skip any fill bytes
+		if (marker < 0 || marker == M_SOS || marker == M_EOI) return found;
+		if (marker == M_TEM || (marker >= M_RST0 && marker <= M_RST7))
+			continue;  // markers without a length
+		hi = source_byte(src);
+		lo = source_byte(src);
+		if (lo < 0) return found;
+		length = (hi << 8) + lo - 2;
+		if (length < 0) return found;
+		int kind = 0;
+		if (capturing && (marker == M_APP1 || marker == M_APP2)) {
+			size_t headerLength = length < CAPTURE_HEADER ? (size_t)length : CAPTURE_HEADER;
+			const uint8_t* head = source_peek(src, headerLength);
+			size_t skip;
+			if (head != NULL) kind = captureKind(ctx, marker, head, headerLength, &skip);
+		}
+		if (kind != 0) {
+			if (marker == M_APP1) STAT_ADD(ctx, app1Segments, 1);
+			if (!source_capture(src, ctx, kind, length)) return found;
+		} else if (marker == M_APP1 && !found && source_at_exif(src, length)) {
+			const uint8_t* data = source_segment(src, ctx, length);
+			if (data == NULL) return 0;
+			if (parse_exif_segment(ctx, data, length)) {
+				if (!capturing) return 1;
+				found = 1;
+			}
+		} else {
+			if (marker == M_APP1) {
+				STAT_ADD(ctx, app1Segments, 1);
+				STAT_ADD(ctx, app1Skipped, 1);
+			}
+			if (!source_skip(src, length)) return found;
+		}
+	}
+}
+
+// exifParseBuffer parses the EXIF data of the JPEG file in buffer into ctx.
+// The tags point into buffer.
+GLOBAL(int)
+exifParseBuffer(j_exif_ptr ctx, const void* buffer, size_t size) {
+	struct marker_source src;
+	memset(&src, 0, sizeof(src));
+	src.buf = (const uint8_t*)buffer;
+	src.size = size;
+	tagmapFree_r(ctx);
+	if (buffer == NULL) return -1;
+	return scan_for_exif(ctx, &src);
+}
+
+// exifParseFile parses the EXIF data of the JPEG file at path into ctx.
+// Where possible the file is mapped and the tags point into the mapping,
+// which is kept until the tags are freed.
+GLOBAL(int)
+exifParseFile(j_exif_ptr ctx, const char* path) {
+	struct marker_source src;
+	int result;
+	memset(&src, 0, sizeof(src));
+
+	tagmapFree_r(ctx);
+#ifdef USE_MMAP
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return -1;
+	struct stat st;
+	if ((ctx->options & EXIF_OPTION_MINIMAL_READ) && fstat(fd, &st) == 0) {
+		src.buf = src.prefix;
+		src.positioned = TRUE;
+		src.fd = fd;
+		src.fileSize = (uint64_t)st.st_size;
+		result = scan_for_exif(ctx, &src);
+		close(fd);
+		ctx->bytesRead = src.bytesRead;
+		return result;
+	}
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED) {
+			close(fd);
+			src.buf = (const uint8_t*)map;
+			src.size = (size_t)st.st_size;
+			result = scan_for_exif(ctx, &src);
+			ctx->bytesRead = src.pos;
+			// captured segments may point into the mapping too
+			if (result == 1 || ctx->metaViews) {
+				ctx->map = map;
+				ctx->mapSize = src.size;
+			} else {
+				munmap(map, src.size);
+			}
+			return result;
+		}
+	}
+	// can't be mapped, read it with stdio instead
+	src.fp = fdopen(fd, "rb");
+	if (src.fp == NULL) {
+		close(fd);
+		return -1;
+	}
+#else
+	src.fp = fopen(path, "rb");
+	if (src.fp == NULL) return -1;
+#endif
+	result = scan_for_exif(ctx, &src);
+	long position = ftell(src.fp);
+	ctx->bytesRead = position > 0 ? (uint64_t)position : 0;
+	fclose(src.fp);
+	return result;
+}
+
+// The convert functions turn n SHORT, LONG or RATIONAL values at src, in
+// the byte order of the segment, into the values the accessors return.  As
+// many values as fill a vector are converted at a time where the processor
+// has one, and the rest one by one.
+
+#ifdef USE_SSE2
+// swap16 and swap32 reverse the bytes in each 16 or 32 bit lane of v.
+static __m128i
+swap16(__m128i v) {
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static __m128i
+swap32(__m128i v) {
+#ifdef __SSSE3__
+	return _mm_shuffle_epi8(v, _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3));
+#else
+	v = swap16(v);
+	return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+#endif
+}
+#endif
+
+static void
+convertShorts(j_exif_ptr ctx, uint32_t* vals, const uint8_t* src, uint32_t n) {
+	uint32_t i = 0;
+#if defined(USE_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+		if (ctx->bigEndian) v = swap16(v);
+		_mm_storeu_si128((__m128i*)(vals + i), _mm_unpacklo_epi16(v, zero));
+		_mm_storeu_si128((__m128i*)(vals + i + 4), _mm_unpackhi_epi16(v, zero));
+	}
+#elif defined(USE_NEON)
+	for (; i + 8 <= n; i += 8) {
+		uint8x16_t v = vld1q_u8(src + 2 * i);
+		if (ctx->bigEndian) v = vrev16q_u8(v);
+		uint16x8_t shorts = vreinterpretq_u16_u8(v);
+		vst1q_u32(vals + i, vmovl_u16(vget_low_u16(shorts)));
+		vst1q_u32(vals + i + 4, vmovl_u16(vget_high_u16(shorts)));
+	}
+#endif
+	for (; i < n; i++) vals[i] = get16(ctx, src + 2 * i);
+}
+
+static void
+convertLongs(j_exif_ptr ctx, uint32_t* vals, const uint8_t* src, uint32_t n) {
+	uint32_t i = 0;
+#if defined(USE_SSE2)
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+		if (ctx->bigEndian) v = swap32(v);
+		_mm_storeu_si128((__m128i*)(vals + i), v);
+	}
+#elif defined(USE_NEON)
+	for (; i + 4 <= n; i += 4) {
+		uint8x16_t v = vld1q_u8(src + 4 * i);
+		if (ctx->bigEndian) v = vrev32q_u8(v);
+		vst1q_u32(vals + i, vreinterpretq_u32_u8(v));
+	}
+#endif
+	for (; i < n; i++) vals[i] = get32(ctx, src + 4 * i);
+}
+
+// convertRationals gives 0 for a value whose denominator is 0.
+static void
+convertRationals(j_exif_ptr ctx, double* vals, const uint8_t* src, uint32_t n, boolean isSigned) {
+	uint32_t i = 0;
+#ifdef USE_SSE2
+	// there is no unsigned conversion, so unsigned values are offset by 2^31
+	// to convert them as signed ones and the offset is added back after
+	const __m128i bias = _mm_set1_epi32(INT32_MIN);
+	const __m128d offset = _mm_set1_pd(isSigned ? 0.0 : 2147483648.0);
+	for (; i + 2 <= n; i += 2) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + 8 * i));
+		if (ctx->bigEndian) v = swap32(v);
+		if (!isSigned) v = _mm_xor_si128(v, bias);
+		__m128d numerator = _mm_add_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(3, 1, 2, 0))), offset);
+		__m128d denominator = _mm_add_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(3, 1, 3, 1))), offset);
+		__m128d val = _mm_div_pd(numerator, denominator);
+		val = _mm_andnot_pd(_mm_cmpeq_pd(denominator, _mm_setzero_pd()), val);
+		_mm_storeu_pd(vals + i, val);
+	}
+#endif
+	for (; i < n; i++) {
+		uint32_t numerator = get32(ctx, src + 8 * i);
+		uint32_t denominator = get32(ctx, src + 8 * i + 4);
+		if (denominator == 0) vals[i] = 0;
+		else if (isSigned) vals[i] = (double)(int32_t)numerator / (double)(int32_t)denominator;
+		else vals[i] = (double)numerator / (double)denominator;
+	}
+}
+
+// The get functions convert the value of an entry to the type the accessors
+// return.  At most max values are written to vals.  They return the number
+// of values written or -1 if the entry has the wrong type.
+
+static int
+getUInt(j_exif_ptr ctx, const struct tagentry* current, uint32_t* vals, uint32_t max) {
+	uint32_t count = current->count < max ? current->count : max;
+	const uint8_t* pvalue = ctx->data + current->offset;
+	if (current->type == TIFF_TYPE_BYTE || current->type == TIFF_TYPE_UNDEFINED) {
+		for (unsigned int i = 0; i < count; i++) {
+			vals[i] = pvalue[i];
+		}
+	} else if (current->type == TIFF_TYPE_SHORT) {
+		convertShorts(ctx, vals, pvalue, count);
+	}	else if (current->type == TIFF_TYPE_LONG) {
+		convertLongs(ctx, vals, pvalue, count);
+	}	else return -1;  // call doesent match IFD type so return -1	
+	return count; // return the number of data words place in the vals array
+}
+
+static int
+getInt(j_exif_ptr ctx, const struct tagentry* current, int32_t* vals, uint32_t max) {
+	uint32_t count = current->count < max ? current->count : max;
+	const uint8_t* pvalue = ctx->data + current->offset;
+	if (current->type == TIFF_TYPE_SLONG) {
+		convertLongs(ctx, (uint32_t*)vals, pvalue, count);
+	}	else return -1;  // call doesent match IFD type so return -1;
+	return count;  // return the number of data words place in the vals array
+}
+
+static int
+getASCII(j_exif_ptr ctx, const struct tagentry* current, char* vals, uint32_t max) {
+	uint32_t count = current->count < max ? current->count : max;
+	const uint8_t* pvalue = ctx->data + current->offset;
+	if (current->type == TIFF_TYPE_ASCII) {
+		for (unsigned int i = 0; i < count; i++) {
+			vals[i] = pvalue[i];
+		}
+	}	else return -1;  // call doesent match IFD type so return -1;
+	return count; // return the number of data words place in the vals array
+}
+
+static int
+getRational(j_exif_ptr ctx, const struct tagentry* current, double* vals, uint32_t max) {
+	uint32_t count = current->count < max ? current->count : max;
+	const uint8_t* pvalue = ctx->data + current->offset;
+	if (current->type == TIFF_TYPE_RATIONAL) {
+		convertRationals(ctx, vals, pvalue, count, FALSE);
+	} else	if (current->type == TIFF_TYPE_SRATIONAL) {
+		convertRationals(ctx, vals, pvalue, count, TRUE);
+	} else return -1;  // call doesent match IFD type so return -1;
+	return count; // return the number of data words place in the vals array
+}
+
+int exifUIntData_r(j_exif_ptr ctx, uint32_t tag, uint32_t* vals) {
+	STAT_ADD(ctx, lookups[EXIF_LOOKUP_UINT], 1);
+	struct tagentry* current = tagmapFind(ctx, tag);
+	if (current == NULL) return 0;  // tag not found
+	return getUInt(ctx, current, vals, current->count);
+}
+
+int exifIntData_r(j_exif_ptr ctx, uint32_t tag, int32_t* vals) {
+	STAT_ADD(ctx, lookups[EXIF_LOOKUP_INT], 1);
+	struct tagentry* current = tagmapFind(ctx, tag);
+	if (current == NULL) return 0;  // tag not found
+	return getInt(ctx, current, vals, current->count);
+}
+
+int exifASCIIData_r(j_exif_ptr ctx, uint32_t tag, char* vals) {
+	STAT_ADD(ctx, lookups[EXIF_LOOKUP_ASCII], 1);
+	struct tagentry* current = tagmapFind(ctx, tag);
+	if (current == NULL) return 0;  // tag not found
+	return getASCII(ctx, current, vals, current->count);
+}
+
+int exifRationalData_r(j_exif_ptr ctx, uint32_t tag, double* vals) {
+	STAT_ADD(ctx, lookups[EXIF_LOOKUP_RATIONAL], 1);
+	struct tagentry* current = tagmapFind(ctx, tag);
+	if (current == NULL) return 0;  // tag not found
+	return getRational(ctx, current, vals, current->count);
+}
+
+// blobCount returns the count the blob and raw accessors give for an entry,
+// which is cut to the blob limit for UNDEFINED tags.
+static int
+blobCount(j_exif_ptr ctx, const struct tagentry* current) {
+	if (current->type == TIFF_TYPE_UNDEFINED && ctx->blobLimit != 0 && current->count > ctx->blobLimit)
+		return (int)ctx->blobLimit;
+	return (int)current->count;
+}
+
+// exifBlobData_r returns the bytes of a BYTE or UNDEFINED tag where they
+// are in the segment.
+GLOBAL(int)
+exifBlobData_r(j_exif_ptr ctx, uint32_t tag, const uint8_t** data) {
+	STAT_ADD(ctx, lookups[EXIF_LOOKUP_BLOB], 1);
+	struct tagentry* current = tagmapFind(ctx, tag);
+	if (current == NULL) return 0;  // tag not found
+	if (current->type != TIFF_TYPE_BYTE && current->type != TIFF_TYPE_UNDEFINED) return -1;
+	*data = ctx->data + current->offset;
+	return blobCount(ctx, current);
+}
+
+// exifRawData_r returns any tag where it is in the segment, for callers
+// that decode the value themselves.
+GLOBAL(int)
+exifRawData_r(j_exif_ptr ctx, uint32_t tag, uint16_t* type, const uint8_t** data) {
+	STAT_ADD(ctx, lookups[EXIF_LOOKUP_RAW], 1);
+	struct tagentry* current = tagmapFind(ctx, tag);
+	if (current == NULL) return 0;  // tag not found
+	*type = current->type;
+	*data = ctx->data + current->offset;
+	return blobCount(ctx, current);
+}
+
+GLOBAL(boolean)
+exifBigEndian_r(j_exif_ptr ctx) {
+	return ctx->bigEndian;
+}
+
+int exifUIntData(uint16_t tag, uint32_t* vals) {
+	return exifUIntData_r(&default_context, tag, vals);
+}
+
+int exifIntData(uint16_t tag, int32_t* vals) {
+	return exifIntData_r(&default_context, tag, vals);
+}
+
+int exifASCIIData(uint16_t tag, char* vals) {
+	return exifASCIIData_r(&default_context, tag, vals);
+}
+
+int exifRationalData(uint16_t tag, double* vals) {
+	return exifRationalData_r(&default_context, tag, vals);
+}
+
+// exifThumbnail_r checks that the thumbnail IFD1 points to is inside the
+// segment and starts like a JPEG file.
+GLOBAL(boolean)
+exifThumbnail_r(j_exif_ptr ctx, const uint8_t** jpeg, size_t* size) {
+	struct tagentry* start = tagmapFindKey(ctx, EXIF_IFD_KEY(EXIF_IFD_1, TIFFJPEGInterchangeFormat));
+	struct tagentry* length = tagmapFindKey(ctx, EXIF_IFD_KEY(EXIF_IFD_1, TIFFJPEGInterchangeFormatLength));
+	uint32_t offset, numBytes;
+	if (start == NULL || length == NULL) return FALSE;
+	if (getUInt(ctx, start, &offset, 1) != 1 || getUInt(ctx, length, &numBytes, 1) != 1) return FALSE;
+	if (offset > (uint32_t)ctx->length - 6) return FALSE;
+	offset += 6;  // tiff header starts at data[6]
+	if (numBytes < 4 || numBytes > (uint32_t)ctx->length - offset) return FALSE;
+	if (ctx->data[offset] != 0xFF || ctx->data[offset + 1] != 0xD8) return FALSE;
+	*jpeg = ctx->data + offset;
+	*size = numBytes;
+	return TRUE;
+}
+
+boolean exifThumbnail(const uint8_t** jpeg, size_t* size) {
+	return exifThumbnail_r(&default_context, jpeg, size);
+}
+
+GLOBAL(boolean)
+exifThumbnailSource_r(j_exif_ptr ctx, j_decompress_ptr cinfo) {
+	const uint8_t* jpeg;
+	size_t size;
+	if (!exifThumbnail_r(ctx, &jpeg, &size)) return FALSE;
+	jpeg_mem_src(cinfo, (unsigned char*)jpeg, size);
+	return TRUE;
+}
+
+
+// This section implements reading a caller defined set of fields straight
+// into the caller's struct.  The descriptors are checked once when the field
+// set is created; exifExtract_r then looks each field up in the tag index
+// and converts it into its bounded destination array.
+
+struct exif_fieldset {
+	int numFields;
+	struct exif_field fields[];
+};
+
+GLOBAL(j_exif_fields)
+exifFieldsCreate(const struct exif_field* fields, int numFields) {
+	if (fields == NULL || numFields < 0) return NULL;
+	for (int i = 0; i < numFields; i++) {
+		uint16_t type = fields[i].type;
+		if (fields[i].maxCount == 0) return NULL;
+		// an ASCII field needs room for a character besides the 0
+		if (type == TIFF_TYPE_ASCII && fields[i].maxCount < 2) return NULL;
+		if (type >= sizeof(typeSize) / sizeof(typeSize[0]) || typeSize[type] == 0) return NULL;
+	}
+	struct exif_fieldset* set = (struct exif_fieldset*)allocMem(sizeof(struct exif_fieldset) +
+		numFields * sizeof(struct exif_field));
+	if (set == NULL) return NULL;
+	set->numFields = numFields;
+	memcpy(set->fields, fields, numFields * sizeof(struct exif_field));
+	return set;
+}
+
+GLOBAL(void)
+exifFieldsDestroy(j_exif_fields set) {
+	freeMem(set);
+}
+
+GLOBAL(int)
+exifExtract_r(j_exif_ptr ctx, j_exif_fields set, void* dst) {
+	int found = 0;
+	for (int i = 0; i < set->numFields; i++) {
+		const struct exif_field* f = &set->fields[i];
+		uint8_t* out = (uint8_t*)dst + f->offset;
+		struct tagentry* current = tagmapFind(ctx, f->tag);
+		STAT_ADD(ctx, lookups[EXIF_LOOKUP_FIELDS], 1);
+		int n = 0;
+		switch (f->type) {
+		case TIFF_TYPE_BYTE:
+		case TIFF_TYPE_SHORT:
+		case TIFF_TYPE_LONG:
+		case TIFF_TYPE_UNDEFINED:
+			if (current != NULL) n = getUInt(ctx, current, (uint32_t*)out, f->maxCount);
+			break;
+		case TIFF_TYPE_SLONG:
+			if (current != NULL) n = getInt(ctx, current, (int32_t*)out, f->maxCount);
+			break;
+		case TIFF_TYPE_ASCII:
+			// leave room to always 0 terminate the string
+			if (current != NULL) n = getASCII(ctx, current, (char*)out, f->maxCount - 1);
+			out[n > 0 ? n : 0] = 0;
+			break;
+		case TIFF_TYPE_RATIONAL:
+		case TIFF_TYPE_SRATIONAL:
+			if (current != NULL) n = getRational(ctx, current, (double*)out, f->maxCount);
+			break;
+		}
+		if (f->countOffset != EXIF_NO_COUNT) *(int*)((uint8_t*)dst + f->countOffset) = n;
+		if (n > 0) found++;
+	}
+	return found;
+}
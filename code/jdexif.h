@@ -1,209 +1,648 @@
-#pragma once
-
-#include <stdint.h>
-
-#ifndef JDEXIF_H
-#define JDEXIF_H
-#ifdef __cplusplus
-extern "C" {
-#endif
-// These functions are for accessing the exif data 
-// 
-// tagmatFree() resets the tag map to free memory and clear tagmap from previous file
-void tagmapFree();
-
-// exifASICData returns the data for tags with type ASCII.  char strings are 0 terminated.
-// The return integer indicates the number of characters found or 0 if tag was not found.
-// If the return interger is -1, then the data type for that exif tag does not match the ascii data types.
-int exifASCIIData(uint16_t tag, char* vals);
-
-// exifUIntData returns the interger data for tags with type UNDEFINED, BYTE, SHORT and LONG.
-// The return integer indicates the number of characters found or 0 if tag was not found.
-// If the return interger is -1, then the data type for that exif tag does not match the unsigned int data types.
-int exifUIntData(uint16_t tag, uint32_t* vals);
-
-// exifIntData returns the interger data for tags with type SLONG.
-// The return integer indicates the number of characters found or 0 if tag was not found.
-// If the return interger is -1, then the data type for that exif tag does not match the signed long data type.
-int exifIntData(uint16_t tag, int32_t* vals);
-
-// exifIntData returns the data for tags with type RATIONAL or SRATIONAL as a post devided double
-// The return integer indicates the number of characters found or 0 if tag was not found.
-// If the return interger is -1, then the data type for that exif tag does not match the rational data types.
-int exifRationalData(uint16_t tag, double* vals);
-
-// tagmapPrint() prints all tags that were captured from the file
-boolean tagmapPrint();
-
-#ifdef __cplusplus
-}
-#endif
-
-
-
-#define TIFF_TYPE_BYTE 1
-#define TIFF_TYPE_ASCII 2
-#define TIFF_TYPE_SHORT 3
-#define TIFF_TYPE_LONG 4
-#define TIFF_TYPE_RATIONAL 5
-#define TIFF_TYPE_UNDEFINED 7
-#define TIFF_TYPE_SLONG 9
-#define TIFF_TYPE_SRATIONAL 10
-
-// Tags for EXIF 2.3 
-
-// Copied from https://www.vieas.com/en/exif23.html
-//		Field			  Tag //    Data type Num Comment
-#define TIFFImageWidth 0x0100 // Short/Long 1 Image width
-#define TIFFImageLength 0x0101 // Short/Long 1 Image height
-#define TIFFBitsPerSample 0x0102 // Short 3 Number of bits per component
-#define TIFFCompression 0x0103 // Short 1 Compression scheme
-#define TIFFPhotometricInterpretation 0x0106 // Short 1 Pixel composition
-#define TIFFImageDescription 0x010E // Ascii Any Image title
-#define TIFFMake 0x010F // Ascii Any Image input equipment manufacturer
-#define TIFFModel 0x0110 // Ascii Any Image input equipment model
-#define TIFFStripOffsets 0x0111 // Short/Long  Image data location
-#define TIFFOrientation 0x0112 // Short 1 Orientation of image
-#define TIFFSamplesPerPixel 0x0115 // Short 1 Number of components
-#define TIFFRowsPerStrip 0x0116 // Short/Long 1 Number of rows per strip
-#define TIFFStripByteCounts 0x0117 // Short/Long  Bytes per compressed strip
-#define TIFFXResolution 0x011A // Rational 1 Image resolution in width direction
-#define TIFFYResolution 0x011B // Rational 1 Image resolution in height direction
-#define TIFFPlanarConfiguration 0x011C // Short 1 Image data arrangement
-#define TIFFResolutionUnit 0x0128 // Short 1 Unit of X and Y resolution
-#define TIFFTransferFunction 0x012D // Short 3*256 Transfer function
-#define TIFFSoftware 0x0131 // Ascii Any Software used
-#define TIFFDateTime 0x0132 // Ascii 20 File change date and time
-#define TIFFArtist 0x013B // Ascii Any Person who created the image
-#define TIFFWhitePoint 0x013E // Rational 2 White point chromaticity
-#define TIFFPrimaryChromaticities 0x013F // Rational 6 Chromaticities of primaries
-#define TIFFJPEGInterchangeFormat 0x0201 // Long 1 Offset to JPEG SOI
-#define TIFFJPEGInterchangeFormatLength 0x0202 // Long 1 Bytes of JPEG data
-#define TIFFYCbCrCoefficients 0x0211 // Rational 3 Color space transformation matrix coefficients
-#define TIFFYCbCrSubSampling 0x0212 // Short 2 Subsampling ratio of Y to C
-#define TIFFYCbCrPositioning 0x0213 // Short 1 Y and C positioning
-#define TIFFReferenceBlackWhite 0x0214 // Rational 6 Pair of black and white reference values
-#define TIFFCopyright 0x8298 // Ascii Any Copyright holder
-#define TIFFExif 0x8769 // Long 1 Exif tag IFD Pointer 
-#define TIFFGPSInfo  0x8825 // Long 1 GPS tagIFD Pointer
-
-//		Field			  Tag    // Data type Num Comment
-#define EXIFExposureTime  0x829A // Rational  1   Exposure time
-#define EXIFFNumber  0x829D // Rational 1 F number
-#define EXIFExposureProgram  0x8822 // Short 1 Exposure program
-#define EXIFSpectralSensitivity  0x8824 // Ascii Any Spectral sensitivity
-#define EXIFPhotographicSensitivity  0x8827 // Short Any Photographic Sensitivity
-#define EXIFOECF  0x8828 // Undefined Any Optoelectric conversion factor
-#define EXIFSensitivityType  0x8830 // Short 1 Sensitivity Type
-#define EXIFStandardOutputSensitivity  0x8831 // Long 1 Standard Output Sensitivity
-#define EXIFRecommendedExposureIndex  0x8832 // Long 1 Recommended Exposure Index
-#define EXIFISOSpeed  0x8833 // Long 1 ISO Speed
-#define EXIFISOSpeedLatitudeyyy  0x8834 // Long 1 ISO Speed Latitude yyy
-#define EXIFISOSpeedLatitudezzz  0x8835 // Long 1 ISO Speed Latitude zzz
-#define EXIFExifVersion  0x9000 // Undefined 4 Exif version
-#define EXIFDateTimeOriginal  0x9003 // Ascii 20 Date and time of original data generation
-#define EXIFDateTimeDigitized  0x9004 // Ascii 20 Date and time of digital data generation
-#define EXIFOffsetTime  0x9010 // Ascii 7 Offset Data of DateTime
-#define EXIFOffsetTimeOriginal  0x9011 // Ascii 7 Offset Data of DateTimeOriginal
-#define EXIFOffsetTimeDigitized  0x9012 // Ascii 7 Offset Data of DateTimeDigitized
-#define EXIFComponentsConfiguration  0x9101 // Undefined 4 Meaning of each component
-#define EXIFCompressedBitsPerPixel  0x9102 // Rational 1 Image compression mode
-#define EXIFShutterSpeedValue  0x9201 // SRational 1 Shutter speed
-#define EXIFApertureValue  0x9202 // Rational 1 Aperture
-#define EXIFBrightnessValue  0x9203 // SRational 1 Brightness
-#define EXIFExposureBiasValue  0x9204 // SRational 1 Exposure bias
-#define EXIFMaxApertureValue  0x9205 // Rational 1 Maximum lens aperture
-#define EXIFSubjectDistance  0x9206 // Rational 1 Subject distance
-#define EXIFMeteringMode  0x9207 // Short 1 Metering mode
-#define EXIFLightSource  0x9208 // Short 1 Light source
-#define EXIFFlash  0x9209 // Short 1 Flash
-#define EXIFFocalLength  0x920A // Rational 1 Lens focal length
-#define EXIFSubjectArea  0x9214 // Short 2/3/2004 Subject area
-#define EXIFMakerNote  0x927C // Undefined Any Manufacturer notes
-#define EXIFUserComment  0x9286 // Undefined Any User comments
-#define EXIFSubSecTime  0x9290 // Ascii Any DateTime subseconds
-#define EXIFSubSecTimeOriginal  0x9291 // Ascii Any DateTimeOriginal subseconds
-#define EXIFSubSecTimeDigitized  0x9292 // Ascii Any DateTimeDigitized subseconds
-#define EXIFTemperature  0x9400 // SRational 1 Temperature
-#define EXIFHumidity  0x9401 // Rational 1 Humidity
-#define EXIFPressure  0x9402 // Rational 1 Pressure
-#define EXIFWaterDepth  0x9403 // SRational 1 Water Depth
-#define EXIFAcceleration  0x9404 // Rational 1 Acceleration
-#define EXIFCameraElevationAngle  0x9404 // SRational 1 Camera Elevation Angle
-#define EXIFFlashpixVersion  0xA000 // Undefined 4 Supported Flashpix version
-#define EXIFColorSpace  0xA001 // Short 1 Color space information
-#define EXIFPixelXDimension  0xA002 // Short/Long 1 Valid image width
-#define EXIFPixelYDimension  0xA003 // Short/Long 1 Valid image height
-#define EXIFRelatedSoundFile  0xA004 // Ascii 13 Related audio file
-#define EXIFInteroperability IFD Pointer  0xA005 // Long 1 Interoperability tag
-#define EXIFFlashEnergy  0xA20B // Rational 1 Flash energy
-#define EXIFSpatialFrequencyResponse  0xA20C // Undefined Any Spatial frequency response
-#define EXIFFocalPlaneXResolution  0xA20E // Rational 1 Focal plane X resolution
-#define EXIFFocalPlaneYResolution  0xA20F // Rational 1 Focal plane Y resolution
-#define EXIFFocalPlaneResolutionUnit  0xA210 // Short 1 Focal plane resolution unit
-#define EXIFSubjectLocation  0xA214 // Short 2 Subject location
-#define EXIFExposureIndex  0xA215 // Rational 1 Exposure index
-#define EXIFSensingMethod  0xA217 // Short 1 Sensing method
-#define EXIFFileSource  0xA300 // Undefined 1 File source
-#define EXIFSceneType  0xA301 // Undefined 1 Scene type
-#define EXIFCFAPattern  0xA302 // Undefined Any CFA pattern
-#define EXIFCustomRendered  0xA401 // Short 1 Custom image processing
-#define EXIFExposureMode  0xA402 // Short 1 Exposure mode
-#define EXIFWhiteBalance  0xA403 // Short 1 White balance
-#define EXIFDigitalZoomRatio  0xA404 // Rational 1 Digital zoom ratio
-#define EXIFFocalLengthIn35mmFilm  0xA405 // Short 1 Focal length in 35 mm film
-#define EXIFSceneCaptureType  0xA406 // Short 1 Scene capture type
-#define EXIFGainControl  0xA407 // Short 1 Gain control
-#define EXIFContrast  0xA408 // Short 1 Contrast
-#define EXIFSaturation  0xA409 // Short 1 Saturation
-#define EXIFSharpness  0xA40A // Short 1 Sharpness
-#define EXIFDeviceSettingDescription  0xA40B // Undefined Any Device settings description
-#define EXIFSubjectDistanceRange  0xA40C // Short 1 Subject distance range
-#define EXIFCompositeImage  0xA460 // Short 1 Composite Image
-#define EXIFSourceImageNumberOfCompositeImage 0xA461 // Short 1 Source Image Number Of Composite Image
-#define EXIFSourceExposureTimesOfCompositeImage 0xA462 // UNDEFINED aNY Source Exposure Times Of Composite Image
-#define EXIFImageUniqueID  0xA420 // Ascii 33 Unique image ID
-#define EXIFCameraOwnerName  0xA430 // Ascii Any Camera Owner Name
-#define EXIFBodySerialNumber  0xA431 // Ascii Any Body Serial Number
-#define EXIFLensSpecification  0xA432 // Rational 4 Lens Specification
-#define EXIFLensMake  0xA433 // Ascii Any Lens Make
-#define EXIFLensModel  0xA434 // Ascii Any Lens Model
-#define EXIFLensSerialNumber  0xA435 // Ascii Any Lens Serial Number
-#define EXIFGamma  0xA500 // Rational 1 Gamma
-
-//		Field		  Tag    // Data type Num Comment
-#define GPSVersionID  0x0000 // Byte      4   GPS tag version
-#define GPSLatitudeRef  0x0001 // Ascii 2 North or South Latitude
-#define GPSLatitude  0x0002 // Rational 3 Latitude
-#define GPSLongitudeRef  0x0003 // Ascii 2 East or West Longitude
-#define GPSLongitude  0x0004 // Rational 3 Longitude
-#define GPSAltitudeRef  0x0005 // Byte 1 Altitude reference
-#define GPSAltitude  0x0006 // Rational 1 Altitude
-#define GPSTimeStamp  0x0007 // Rational 3 GPS time (atomic clock)
-#define GPSSatellites  0x0008 // Ascii Any GPS satellites used for measurement
-#define GPSStatus  0x0009 // Ascii 2 GPS receiver status
-#define GPSMeasureMode  0x000A // Ascii 2 GPS measurement mode
-#define GPSDOP  0x000B // Rational 1 Measurement precision
-#define GPSSpeedRef  0x000C // Ascii 2 Speed unit
-#define GPSSpeed  0x000D // Rational 1 Speed of GPS receiver
-#define GPSTrackRef  0x000E // Ascii 2 Reference for direction of movement
-#define GPSTrack  0x000F // Rational 1 Direction of movement
-#define GPSImgDirectionRef  0x0010 // Ascii 2 Reference for direction of image
-#define GPSImgDirection  0x0011 // Rational 1 Direction of image
-#define GPSMapDatum  0x0012 // Ascii Any Geodetic survey data used
-#define GPSDestLatitudeRef  0x0013 // Ascii 2 Reference for latitude of destination
-#define GPSDestLatitude  0x0014 // Rational 3 Latitude of destination
-#define GPSDestLongitudeRef  0x0015 // Ascii 2 Reference for longitude of destination
-#define GPSDestLongitude  0x0016 // Rational 3 Longitude of destination
-#define GPSDestBearingRef  0x0017 // Ascii 2 Reference for bearing of destination
-#define GPSDestBearing  0x0018 // Rational 1 Bearing of destination
-#define GPSDestDistanceRef  0x0019 // Ascii 2 Reference for distance to destination
-#define GPSDestDistance  0x001A // Rational 1 Distance to destination
-#define GPSProcessingMethod  0x001B // Undefined Any Name of GPS processing method
-#define GPSAreaInformation  0x001C // Undefined Any Name of GPS area
-#define GPSDateStamp  0x001D // Ascii 11 GPS date
-#define GPSDifferential  0x001E // Short 1 GPS differential correction
-#define GPSHPositioningError  0x001F // Rational 1 Horizontal positioning error
-
-
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef JDEXIF_H
+#define JDEXIF_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+// These functions are for accessing the exif data 
+// 
+// tagmatFree() resets the tag map to free memory and clear tagmap from previous file
+void tagmapFree();
+
+// exifASICData returns the data for tags with type ASCII.  char strings are 0 terminated.
+// The return integer indicates the number of characters found or 0 if tag was not found.
+// If the return interger is -1, then the data type for that exif tag does not match the ascii data types.
+int exifASCIIData(uint16_t tag, char* vals);
+
+// exifUIntData returns the interger data for tags with type UNDEFINED, BYTE, SHORT and LONG.
+// The return integer indicates the number of characters found or 0 if tag was not found.
+// If the return interger is -1, then the data type for that exif tag does not match the unsigned int data types.
+int exifUIntData(uint16_t tag, uint32_t* vals);
+
+// exifIntData returns the interger data for tags with type SLONG.
+// The return integer indicates the number of characters found or 0 if tag was not found.
+// If the return interger is -1, then the data type for that exif tag does not match the signed long data type.
+int exifIntData(uint16_t tag, int32_t* vals);
+
+// exifIntData returns the data for tags with type RATIONAL or SRATIONAL as a post devided double
+// The return integer indicates the number of characters found or 0 if tag was not found.
+// If the return interger is -1, then the data type for that exif tag does not match the rational data types.
+int exifRationalData(uint16_t tag, double* vals);
+
+// tagmapPrint() prints all tags that were captured from the file
+boolean tagmapPrint();
+
+// exifThumbnail finds the JPEG thumbnail described by IFD1 and returns TRUE
+// if there is one.  *jpeg is set to the thumbnail inside the EXIF data, which
+// stays valid until the tags are freed, and *size to its length.  Nothing is
+// copied.
+boolean exifThumbnail(const uint8_t** jpeg, size_t* size);
+
+// Reentrant interface.
+// The functions above keep the tags of the last file read in one static map,
+// so only one image can be decoded at a time.  An exif context holds the tags
+// for one decompressor instead.  Create one per decompressor (or per thread),
+// call exifAttach(cinfo, ctx) after jpeg_create_decompress and before
+// jpeg_read_header, then use the _r accessors with that context.
+// exifAttach uses cinfo->client_data to find the context.
+typedef struct exif_context* j_exif_ptr;
+
+// exifCreate returns a new empty context or NULL if out of memory.
+j_exif_ptr exifCreate(void);
+
+// exifDestroy frees the context and all the tags it holds.
+void exifDestroy(j_exif_ptr ctx);
+
+// exifAttach makes the decompressor parse APP1 EXIF data into ctx.  ctx is
+// emptied at the start of each image the decompressor reads, so its tags
+// and captured segments are always those of the last jpeg_read_header.
+void exifAttach(j_decompress_ptr cinfo, j_exif_ptr ctx);
+
+// exifSetAllocator replaces malloc and free for all the memory the extension
+// allocates, for example to count allocations.  Passing NULL restores them.
+// Call it before any context is created.
+void exifSetAllocator(void* (*allocFn)(size_t), void (*freeFn)(void*));
+
+// exifBytesCopied_r returns the number of bytes ctx has copied out of the
+// files read into it since it was created.  Mapped files and buffers given to
+// exifParseBuffer are parsed in place and add nothing.
+uint64_t exifBytesCopied_r(j_exif_ptr ctx);
+
+// exifBytesRead_r returns the number of bytes of the file the last
+// exifParseFile into ctx read.  With EXIF_OPTION_MINIMAL_READ that is what
+// was actually read, otherwise the part of the file up to where the markers
+// were walked, which the system reads at least.  It is 0 after any other
+// way of filling ctx.
+uint64_t exifBytesRead_r(j_exif_ptr ctx);
+
+// exifParseFile and exifParseBuffer read the EXIF data of a JPEG file into ctx
+// without a decompressor.  Only the markers up to the first EXIF APP1 segment
+// are read, so they are much faster than jpeg_read_header when no pixels are
+// needed.  The previous contents of ctx are cleared first.
+// The return integer is 1 if EXIF data was found and 0 if not.
+// If the return interger is -1, then the file could not be read or is not a JPEG file.
+int exifParseFile(j_exif_ptr ctx, const char* path);
+int exifParseBuffer(j_exif_ptr ctx, const void* buffer, size_t size);
+
+// exifSetOptions sets the options of ctx, a combination of the EXIF_OPTION_
+// values.  They apply to all the files read into ctx afterwards.
+// EXIF_OPTION_LAZY only records where the IFDs are when the APP1 segment is
+// read, and decodes each entry the first time it is looked up.  That makes
+// reading a file much cheaper when only a few tags are used.
+#define EXIF_OPTION_LAZY 0x0001
+// EXIF_OPTION_MINIMAL_READ makes exifParseFile read the file with pread
+// instead of mapping it, and only read the bytes it needs: a short prefix,
+// the 4 byte header of each marker up to the EXIF segment, and the rest of
+// that segment with one read of its exact size.  The data of the other
+// segments and the compressed image are never read.  That saves most of the
+// I/O on network and object storage.  It needs pread; without it the option
+// is ignored.
+#define EXIF_OPTION_MINIMAL_READ 0x0002
+// The EXIF_OPTION_CAPTURE_ options keep other metadata segments of the file
+// with the tags, so one pass over the headers gets all the metadata: XMP
+// packets in APP1, ICC profiles in APP2, which are put together again when
+// they are split over several segments, and the MPF index of multi-picture
+// files in APP2.  exifParseFile and exifParseBuffer then walk the markers
+// up to the image data instead of stopping at the EXIF segment.  Set them
+// before exifAttach, which only takes over the APP2 marker when needed.
+// For the functions without _r, patch process_exif_parameters into
+// jdmarker.c as the APP2 processor too.
+#define EXIF_OPTION_CAPTURE_XMP 0x0004
+#define EXIF_OPTION_CAPTURE_ICC 0x0008
+#define EXIF_OPTION_CAPTURE_MPF 0x0010
+void exifSetOptions(j_exif_ptr ctx, unsigned int options);
+
+// exifMetadata_r returns TRUE and the captured segment of a kind, without
+// its signature: the XMP packet, the ICC profile, or the MPF data starting
+// with its TIFF header.  *data points into a mapped file or the buffer given
+// to exifParseBuffer where it can, and otherwise into ctx.  It is valid
+// until the next file is read into ctx.  It returns FALSE if the file had no
+// such segment, or for an ICC profile if a chunk is missing.
+#define EXIF_METADATA_XMP 1
+#define EXIF_METADATA_ICC 2
+#define EXIF_METADATA_MPF 3
+boolean exifMetadata_r(j_exif_ptr ctx, int kind, const uint8_t** data, size_t* size);
+
+// These behave the same as the functions above but operate on ctx.
+// The tags of each IFD are kept apart.  A plain tag is looked up in IFD0,
+// then the Exif IFD, then the GPS IFD, then IFD1.  To look in one IFD only, pass
+// EXIF_IFD_KEY(ifd, tag) as the tag, e.g. EXIF_IFD_KEY(EXIF_IFD_GPS, GPSLatitude).
+void tagmapFree_r(j_exif_ptr ctx);
+int exifASCIIData_r(j_exif_ptr ctx, uint32_t tag, char* vals);
+int exifUIntData_r(j_exif_ptr ctx, uint32_t tag, uint32_t* vals);
+int exifIntData_r(j_exif_ptr ctx, uint32_t tag, int32_t* vals);
+int exifRationalData_r(j_exif_ptr ctx, uint32_t tag, double* vals);
+boolean tagmapPrint_r(j_exif_ptr ctx);
+boolean exifThumbnail_r(j_exif_ptr ctx, const uint8_t** jpeg, size_t* size);
+
+// exifThumbnailSource_r makes cinfo read the thumbnail of ctx with
+// jpeg_mem_src, so a preview can be decoded instead of the main image.  It
+// returns FALSE and leaves cinfo alone if there is no thumbnail.  cinfo must
+// not be attached to ctx, as reading the thumbnail would clear it.
+boolean exifThumbnailSource_r(j_exif_ptr ctx, j_decompress_ptr cinfo);
+
+// exifTagList_r returns the number of tags in ctx.  If keys isn't NULL, the
+// first maxKeys tags are stored in it as EXIF_IFD_KEY(ifd, tag) values.
+int exifTagList_r(j_exif_ptr ctx, uint32_t* keys, int maxKeys);
+
+// exifTagInfo_r returns TRUE and the TIFF type and count of the tag, or
+// FALSE if the tag was not found.  type or count may be NULL.
+boolean exifTagInfo_r(j_exif_ptr ctx, uint32_t tag, uint16_t* type, uint32_t* count);
+
+// Field sets read many fields into a struct of the caller's in one call.
+// Describe each field once with an exif_field, create a field set from the
+// table with exifFieldsCreate, then call exifExtract_r for every image.
+// The destination of a field is an array of maxCount elements whose type
+// follows the field's TIFF type: uint32_t for BYTE, SHORT, LONG and
+// UNDEFINED, int32_t for SLONG, double for RATIONAL and SRATIONAL, and char
+// for ASCII.  No more than maxCount values are written, and ASCII strings
+// are cut to maxCount - 1 characters and are always 0 terminated.
+// The count of a field is the number the matching accessor would return:
+// the number of values written, 0 if the tag was not found or -1 if it has
+// the wrong type.  Use offsetof() to fill in offset and countOffset.
+#define EXIF_NO_COUNT ((size_t)-1)
+
+struct exif_field {
+	uint32_t tag;       // tag, or EXIF_IFD_KEY(ifd, tag)
+	uint16_t type;      // expected TIFF type, TIFF_TYPE_ASCII etc.
+	uint16_t maxCount;  // number of elements in the destination array
+	size_t offset;      // offset of the destination array in the struct
+	size_t countOffset; // offset of an int to store the count in, or EXIF_NO_COUNT
+};
+
+typedef struct exif_fieldset* j_exif_fields;
+
+// exifFieldsCreate returns a field set for the numFields descriptors in
+// fields, or NULL if a descriptor is invalid or out of memory.  An ASCII
+// field needs a maxCount of at least 2, one character and the 0.
+j_exif_fields exifFieldsCreate(const struct exif_field* fields, int numFields);
+void exifFieldsDestroy(j_exif_fields set);
+
+// exifExtract_r fills the struct at dst with the fields of set and returns
+// the number of fields that were found.
+int exifExtract_r(j_exif_ptr ctx, j_exif_fields set, void* dst);
+
+// An interest set bounds what is kept of an image to the tags that are used.
+// Create it from a list of tags, each a plain tag for all IFDs or
+// EXIF_IFD_KEY(ifd, tag) for one, and give it to exifSetInterest_r before
+// reading files into ctx.  The other entries are skipped while the IFDs are
+// walked, so MakerNote and other large or numerous tags take no memory.
+// A set may be shared by many contexts; it must outlive their use of it.
+// exifThumbnail_r needs the IFD1 tags 0x0201 and 0x0202 to be in the set.
+// Passing NULL to exifSetInterest_r keeps all tags again.
+typedef struct exif_interest* j_exif_interest;
+
+j_exif_interest exifInterestCreate(const uint32_t* tags, int numTags);
+void exifInterestDestroy(j_exif_interest set);
+void exifSetInterest_r(j_exif_ptr ctx, j_exif_interest set);
+
+// exifSetBlobLimit_r caps the count exifBlobData_r and exifRawData_r return
+// for an UNDEFINED tag at maxBytes, so a caller that walks the bytes can't
+// be made to go through a large blob by accident.  0, the default, is no
+// limit.  exifUIntData_r and field sets always convert all the values they
+// have room for.
+// exifBlobData_r returns the count of a BYTE or UNDEFINED tag and sets *data
+// to its bytes in the APP1 segment, without copying them.  *data is valid
+// until the next file is read into ctx.  It returns 0 if the tag was not
+// found and -1 if it has another type.
+void exifSetBlobLimit_r(j_exif_ptr ctx, uint32_t maxBytes);
+int exifBlobData_r(j_exif_ptr ctx, uint32_t tag, const uint8_t** data);
+
+// exifRawData_r returns the count of a tag of any type and sets *type to its
+// TIFF type and *data to its values in the APP1 segment, in the byte order
+// exifBigEndian_r reports.  Nothing is converted or copied; jdexif.hpp
+// builds typed C++ access on these two.  *data is valid until the next file
+// is read into ctx.  It returns 0 if the tag was not found.
+int exifRawData_r(j_exif_ptr ctx, uint32_t tag, uint16_t* type, const uint8_t** data);
+boolean exifBigEndian_r(j_exif_ptr ctx);
+
+// The EXIF writer, in jdexifwrite.c, changes the tags of a JPEG file
+// without decoding the image.  Create an editor from the tags of a file
+// read into ctx (or from NULL to start with no tags), add, change and delete
+// tags, and exifRewriteFile copies the file with a new EXIF segment in place
+// of the old one.  All the other segments and the compressed image are
+// copied byte for byte.
+typedef struct exif_editor* j_exif_edit;
+
+// exifEditCreate copies the tags of ctx into a new editor, so ctx may be
+// used for other files afterwards.  It returns NULL if out of memory or if
+// ctx has an interest set, as the tags it skipped would be lost.
+j_exif_edit exifEditCreate(j_exif_ptr ctx);
+void exifEditDestroy(j_exif_edit ed);
+
+// exifEditSet adds a tag or replaces its value.  values points to count
+// values in the C type of the TIFF type: uint8_t for BYTE, ASCII and
+// UNDEFINED, uint16_t for SHORT, uint32_t for LONG, int32_t for SLONG, and
+// numerator and denominator pairs of uint32_t or int32_t for RATIONAL and
+// SRATIONAL.  The count of an ASCII value includes its terminating 0.  A
+// plain tag refers to the IFD an accessor would find it in, and goes in
+// IFD0 if it isn't there; use EXIF_IFD_KEY for the tags of other IFDs.
+// It returns FALSE for the tags that link the IFDs and the thumbnail, which
+// the writer lays out itself, for an invalid type or if out of memory.
+boolean exifEditSet(j_exif_edit ed, uint32_t tag, uint16_t type, uint32_t count, const void* values);
+
+// exifEditDelete removes a tag and returns FALSE if it wasn't there.
+// Deleting IFD1's JPEGInterchangeFormat drops the thumbnail.
+// exifEditDeleteIFD removes all the tags of an IFD, for example
+// EXIF_IFD_GPS to strip the location from a file.
+boolean exifEditDelete(j_exif_edit ed, uint32_t tag);
+void exifEditDeleteIFD(j_exif_edit ed, uint32_t ifd);
+
+// exifEditSerialize writes the payload of the new APP1 segment, starting
+// with the Exif header, to buffer if it has room for it, and returns its
+// size.  That is what jpeg_write_marker takes.  It returns 0 if there are
+// no tags or they don't fit in a segment.
+size_t exifEditSerialize(j_exif_edit ed, uint8_t* buffer, size_t size);
+
+// exifRewriteFile writes the JPEG file at inPath to outPath with the tags of
+// ed.  outPath is replaced only once it is complete, and may be inPath.
+// Without tags the EXIF segment is left out.  Returns FALSE if the file
+// can't be read or written, isn't a JPEG file, or the tags don't fit.
+boolean exifRewriteFile(j_exif_edit ed, const char* inPath, const char* outPath);
+
+// Statistics.  When the library is compiled with EXIF_STATS defined, every
+// context counts what it does in an exif_stats.  Without it nothing is
+// counted and exifStatsCollect_r returns FALSE, so the counting costs
+// nothing unless it is asked for.  The counters of a context are only
+// written by the thread using it, so collect them from that thread, for
+// example into a total of the process under a lock after each batch of
+// files.  They are kept until exifStatsReset_r is called.
+enum exif_lookup {
+	EXIF_LOOKUP_ASCII,     // exifASCIIData_r
+	EXIF_LOOKUP_UINT,      // exifUIntData_r
+	EXIF_LOOKUP_INT,       // exifIntData_r
+	EXIF_LOOKUP_RATIONAL,  // exifRationalData_r
+	EXIF_LOOKUP_BLOB,      // exifBlobData_r
+	EXIF_LOOKUP_INFO,      // exifTagInfo_r
+	EXIF_LOOKUP_FIELDS,    // exifExtract_r, one per field
+	EXIF_LOOKUP_RAW,       // exifRawData_r
+	EXIF_LOOKUP_COUNT
+};
+
+struct exif_stats {
+	uint64_t app1Segments;      // APP1 segments seen
+	uint64_t app1Skipped;       // APP1 segments that were not EXIF, such as XMP
+	uint64_t exifSegments;      // EXIF segments parsed
+	uint64_t rejectedSegments;  // EXIF segments with a malformed header or IFD0
+	uint64_t bytesIngested;     // bytes of the EXIF segments parsed
+	uint64_t tagsStored[5];     // tags stored, by EXIF_IFD_ value
+	uint64_t allocations;       // allocations made for the context
+	uint64_t bytesAllocated;
+	uint64_t parseNanoseconds;  // time spent parsing EXIF segments
+	uint64_t lookups[EXIF_LOOKUP_COUNT];
+};
+
+// exifStatsCollect_r adds the counters of ctx to *stats, so the counters
+// of many contexts can be summed.  Returns FALSE if the library was built
+// without EXIF_STATS.
+// exifStatsCollect and exifStatsReset do the same for the context of the
+// functions without _r, that process_exif_parameters fills.
+boolean exifStatsCollect_r(j_exif_ptr ctx, struct exif_stats* stats);
+void exifStatsReset_r(j_exif_ptr ctx);
+boolean exifStatsCollect(struct exif_stats* stats);
+void exifStatsReset(void);
+
+// exifStatsPrint prints the counters of stats like tagmapPrint prints the tags.
+void exifStatsPrint(const struct exif_stats* stats);
+
+// The metadata cache, in jdexifcache.c, keeps the tags of the files parsed
+// through it in a cache file, so that they can be read again without opening
+// the files as long as they don't change.  A file is known by its path, size,
+// modification time and inode.  Several processes can read and add to the
+// same cache file at once.  A cache is used by one thread at a time; open
+// one per thread.  It needs mmap and flock; where they are missing
+// exifCacheOpen returns NULL and the files are always parsed.
+typedef struct exif_cache* j_exif_cache;
+
+// exifCacheOpen opens the cache file at path, or creates it if writable is
+// set.  Only a writable cache adds the files it parses to the cache file.
+// A writable cache starts the file again if it was written by a version of
+// the library with another format.  Returns NULL if the file can't be opened
+// or is not a cache file of this format.
+j_exif_cache exifCacheOpen(const char* path, boolean writable);
+void exifCacheClose(j_exif_cache cache);
+
+// exifParseFileCached behaves like exifParseFile, but takes the tags from
+// cache when the file hasn't changed since it was added.  The tags are
+// copied into ctx, so they stay valid when the cache is closed.  cache may
+// be NULL.
+int exifParseFileCached(j_exif_ptr ctx, j_exif_cache cache, const char* path);
+
+// exifCacheCompact rewrites the cache file with only the newest record of
+// each file, and if dropStale is set only those of files that still exist
+// unchanged.  Other caches open on the file switch to the new one.
+boolean exifCacheCompact(j_exif_cache cache, boolean dropStale);
+
+// exifCacheStats returns the number of files exifParseFileCached took from
+// the cache and the number it had to parse.
+void exifCacheStats(j_exif_cache cache, long* hits, long* misses);
+
+// Column batches, in jdexifbatch.c, read a few common fields of many files
+// into one array per field, ready to hand to vectorized code or to an Arrow
+// or Parquet writer as they are.  Row i of every column is the i-th file
+// appended.  Each column has a validity bitmap as Arrow has them, with bit
+// i % 8 of byte i / 8 set if row i has a value.  A row without a value,
+// because the file doesn't have the field or it doesn't make sense, has a
+// clear bit and a 0.
+enum exif_column {
+	EXIF_COLUMN_TIMESTAMP,    // int64_t DateTimeOriginal in seconds since 1970
+	EXIF_COLUMN_LATITUDE,     // double GPSLatitude in decimal degrees, south negative
+	EXIF_COLUMN_LONGITUDE,    // double GPSLongitude in decimal degrees, west negative
+	EXIF_COLUMN_EXPOSURE,     // double ExposureTime in seconds
+	EXIF_COLUMN_ISO,          // uint32_t PhotographicSensitivity, or ISOSpeed
+	EXIF_COLUMN_ORIENTATION,  // uint8_t Orientation, 1 to 8
+	EXIF_COLUMN_COUNT
+};
+#define EXIF_COLUMN_BIT(column) (1u << (column))
+
+// The members of exif_columns are read only.  The arrays of the columns
+// that were not asked for are NULL.  The timestamp is in UTC when the file
+// has OffsetTimeOriginal, and otherwise in the camera's local time as if
+// it were UTC.  The ISO column takes ISOSpeed when PhotographicSensitivity
+// is 65535, meaning too large for a SHORT.
+struct exif_columns {
+	size_t rows;
+	size_t capacity;
+	unsigned int columns;       // EXIF_COLUMN_BIT of the columns kept
+	int64_t* timestamp;
+	double* latitude;
+	double* longitude;
+	double* exposure;
+	uint32_t* iso;
+	uint8_t* orientation;
+	uint8_t* valid[EXIF_COLUMN_COUNT];
+	j_exif_fields fields;       // the fields read for a row
+	j_exif_interest interest;   // the tags of those fields
+};
+
+typedef struct exif_columns* j_exif_columns;
+
+// exifColumnsCreate returns an empty batch of the columns given as
+// EXIF_COLUMN_BIT values, with room for capacity rows, or NULL if columns
+// is invalid or out of memory.  The columns grow as rows are appended.
+j_exif_columns exifColumnsCreate(unsigned int columns, size_t capacity);
+void exifColumnsDestroy(j_exif_columns cols);
+
+// exifColumnsClear removes all rows, keeping the arrays for the next batch.
+void exifColumnsClear(j_exif_columns cols);
+
+// exifColumnsAppend_r appends a row with the tags of ctx, however they were
+// read.  Returns FALSE if out of memory.
+boolean exifColumnsAppend_r(j_exif_ptr ctx, j_exif_columns cols);
+
+// exifColumnsParseFiles_r reads each of paths into ctx with exifParseFile
+// and appends a row for it, so the rows line up with paths; files that
+// can't be read have no valid fields.  Unless ctx has an interest set of its
+// own, only the tags of the columns are kept while the files are read.  The
+// options of ctx apply, so EXIF_OPTION_MINIMAL_READ can be set first.
+// Returns the number of rows appended, fewer than numPaths if out of memory.
+size_t exifColumnsParseFiles_r(j_exif_ptr ctx, j_exif_columns cols, const char* const* paths, size_t numPaths);
+
+// The asynchronous reader, in jdexifasync.c, parses many files with the
+// reads of up to depth of them in flight at once, so that scanning a large
+// directory is not held up by the latency of each read.  The first prefix
+// bytes of each file are read into a buffer of the reader, with io_uring
+// when built with EXIF_USE_IO_URING and liburing, or otherwise with a
+// thread per buffer, and parsed with exifParseBuffer as soon as the read
+// completes.  A file whose EXIF data doesn't fit in the prefix is parsed
+// again with exifParseFile.  A reader is used by one thread at a time.
+typedef struct exif_async* j_exif_async;
+
+// exif_async_done receives ctx with the tags of paths[index] and what
+// exifParseFile would have returned for it.  The files complete in any
+// order.  The tags may point into the buffer of the reader, so they are
+// only valid until done returns.
+typedef void (*exif_async_done)(j_exif_ptr ctx, size_t index, int result, void* user);
+
+// exifAsyncCreate returns a reader with depth buffers of prefix bytes, or
+// NULL if out of memory.  0 selects 64 buffers of 72 KB, which hold the
+// largest APP1 segment behind an APP0 segment.
+j_exif_async exifAsyncCreate(int depth, size_t prefix);
+void exifAsyncDestroy(j_exif_async async);
+
+// exifAsyncParseFiles reads each of paths into ctx and calls done with it,
+// on the caller's thread.  Returns the number of files given to done, which
+// is numPaths.
+size_t exifAsyncParseFiles(j_exif_async async, j_exif_ptr ctx, const char* const* paths, size_t numPaths,
+	exif_async_done done, void* user);
+
+// exifAsyncBytesRead returns the number of bytes of the files the reader
+// has read since it was created.
+uint64_t exifAsyncBytesRead(j_exif_async async);
+
+// Decode planning, in jdexifplan.c, uses the orientation of the EXIF data to
+// decode an image for display at a size of at most maxWidth by maxHeight,
+// for example for a thumbnail, in one pass.  exifPlanDecode_r is called
+// between jpeg_read_header and jpeg_start_decompress on a decompressor
+// attached to ctx.  It sets scale_num and scale_denom of cinfo to the
+// smallest scale whose image, once turned upright, is at least as large as
+// the image fitted into the bounds, so the caller only shrinks it by less
+// than 2 after.  A bound of 0 is none.  exifPlanWriteRows then writes the
+// rows jpeg_read_scanlines returns upright into dest, an image of width by
+// height pixels of components samples, whose rows are destStride bytes
+// apart.  Returns FALSE if cinfo has no image size.
+struct exif_decode_plan {
+	int orientation;              // TIFFOrientation, 1 if missing or not valid
+	boolean transpose;            // rows become columns, for orientations 5 to 8
+	boolean flipX;                // then right is left
+	boolean flipY;                // then bottom is top
+	unsigned int scaleNum;        // as set in cinfo
+	unsigned int scaleDenom;
+	JDIMENSION decodedWidth;      // output_width of cinfo
+	JDIMENSION decodedHeight;     // output_height of cinfo
+	JDIMENSION width;             // of the upright image in dest
+	JDIMENSION height;
+	JDIMENSION fitWidth;          // of that image fitted into the bounds
+	JDIMENSION fitHeight;
+	int components;               // output_components of cinfo
+};
+
+boolean exifPlanDecode_r(j_exif_ptr ctx, j_decompress_ptr cinfo, JDIMENSION maxWidth, JDIMENSION maxHeight,
+	struct exif_decode_plan* plan);
+void exifPlanWriteRows(const struct exif_decode_plan* plan, JSAMPARRAY rows, JDIMENSION firstRow,
+	JDIMENSION numRows, JSAMPLE* dest, size_t destStride);
+
+#ifdef __cplusplus
+}
+#endif
+
+
+
+#define TIFF_TYPE_BYTE 1
+#define TIFF_TYPE_ASCII 2
+#define TIFF_TYPE_SHORT 3
+#define TIFF_TYPE_LONG 4
+#define TIFF_TYPE_RATIONAL 5
+#define TIFF_TYPE_UNDEFINED 7
+#define TIFF_TYPE_SLONG 9
+#define TIFF_TYPE_SRATIONAL 10
+
+// IFDs the tags are kept in
+#define EXIF_IFD_ANY 0   // search IFD0, Exif, GPS and IFD1 in that order
+#define EXIF_IFD_0 1     // TIFF tags of the main image
+#define EXIF_IFD_EXIF 2  // Exif SubIFD
+#define EXIF_IFD_GPS 3   // GPS SubIFD
+#define EXIF_IFD_1 4     // TIFF tags of the thumbnail
+#define EXIF_IFD_KEY(ifd, tag) (((uint32_t)(ifd) << 16) | (uint16_t)(tag))
+
+// Tags for EXIF 2.3 
+
+// Copied from https://www.vieas.com/en/exif23.html
+//		Field			  Tag //    Data type Num Comment
+#define TIFFImageWidth 0x0100 // Short/Long 1 Image width
+#define TIFFImageLength 0x0101 // Short/Long 1 Image height
+#define TIFFBitsPerSample 0x0102 // Short 3 Number of bits per component
+#define TIFFCompression 0x0103 // Short 1 Compression scheme
+#define TIFFPhotometricInterpretation 0x0106 // Short 1 Pixel composition
+#define TIFFImageDescription 0x010E // Ascii Any Image title
+#define TIFFMake 0x010F // Ascii Any Image input equipment manufacturer
+#define TIFFModel 0x0110 // Ascii Any Image input equipment model
+#define TIFFStripOffsets 0x0111 // Short/Long  Image data location
+#define TIFFOrientation 0x0112 // Short 1 Orientation of image
+#define TIFFSamplesPerPixel 0x0115 // Short 1 Number of components
+#define TIFFRowsPerStrip 0x0116 // Short/Long 1 Number of rows per strip
+#define TIFFStripByteCounts 0x0117 // Short/Long  Bytes per compressed strip
+#define TIFFXResolution 0x011A // Rational 1 Image resolution in width direction
+#define TIFFYResolution 0x011B // Rational 1 Image resolution in height direction
+#define TIFFPlanarConfiguration 0x011C // Short 1 Image data arrangement
+#define TIFFResolutionUnit 0x0128 // Short 1 Unit of X and Y resolution
+#define TIFFTransferFunction 0x012D // Short 3*256 Transfer function
+#define TIFFSoftware 0x0131 // Ascii Any Software used
+#define TIFFDateTime 0x0132 // Ascii 20 File change date and time
+#define TIFFArtist 0x013B // Ascii Any Person who created the image
+#define TIFFWhitePoint 0x013E // Rational 2 White point chromaticity
+#define TIFFPrimaryChromaticities 0x013F // Rational 6 Chromaticities of primaries
+#define TIFFJPEGInterchangeFormat 0x0201 // Long 1 Offset to JPEG SOI
+#define TIFFJPEGInterchangeFormatLength 0x0202 // Long 1 Bytes of JPEG data
+#define TIFFYCbCrCoefficients 0x0211 // Rational 3 Color space transformation matrix coefficients
+#define TIFFYCbCrSubSampling 0x0212 // Short 2 Subsampling ratio of Y to C
+#define TIFFYCbCrPositioning 0x0213 // Short 1 Y and C positioning
+#define TIFFReferenceBlackWhite 0x0214 // Rational 6 Pair of black and white reference values
+#define TIFFCopyright 0x8298 // Ascii Any Copyright holder
+#define TIFFExif 0x8769 // Long 1 Exif tag IFD Pointer 
+#define TIFFGPSInfo  0x8825 // Long 1 GPS tagIFD Pointer
+
+//		Field			  Tag    // Data type Num Comment
+#define EXIFExposureTime  0x829A // Rational  1   Exposure time
+#define EXIFFNumber  0x829D // Rational 1 F number
+#define EXIFExposureProgram  0x8822 // Short 1 Exposure program
+#define EXIFSpectralSensitivity  0x8824 // Ascii Any Spectral sensitivity
+#define EXIFPhotographicSensitivity  0x8827 // Short Any Photographic Sensitivity
+#define EXIFOECF  0x8828 // Undefined Any Optoelectric conversion factor
+#define EXIFSensitivityType  0x8830 // Short 1 Sensitivity Type
+#define EXIFStandardOutputSensitivity  0x8831 // Long 1 Standard Output Sensitivity
+#define EXIFRecommendedExposureIndex  0x8832 // Long 1 Recommended Exposure Index
+#define EXIFISOSpeed  0x8833 // Long 1 ISO Speed
+#define EXIFISOSpeedLatitudeyyy  0x8834 // Long 1 ISO Speed Latitude yyy
+#define EXIFISOSpeedLatitudezzz  0x8835 // Long 1 ISO Speed Latitude zzz
+#define EXIFExifVersion  0x9000 // Undefined 4 Exif version
+#define EXIFDateTimeOriginal  0x9003 // Ascii 20 Date and time of original data generation
+#define EXIFDateTimeDigitized  0x9004 // Ascii 20 Date and time of digital data generation
+#define EXIFOffsetTime  0x9010 // Ascii 7 Offset Data of DateTime
+#define EXIFOffsetTimeOriginal  0x9011 // Ascii 7 Offset Data of DateTimeOriginal
+#define EXIFOffsetTimeDigitized  0x9012 // Ascii 7 Offset Data of DateTimeDigitized
+#define EXIFComponentsConfiguration  0x9101 // Undefined 4 Meaning of each component
+#define EXIFCompressedBitsPerPixel  0x9102 // Rational 1 Image compression mode
+#define EXIFShutterSpeedValue  0x9201 // SRational 1 Shutter speed
+#define EXIFApertureValue  0x9202 // Rational 1 Aperture
+#define EXIFBrightnessValue  0x9203 // SRational 1 Brightness
+#define EXIFExposureBiasValue  0x9204 // SRational 1 Exposure bias
+#define EXIFMaxApertureValue  0x9205 // Rational 1 Maximum lens aperture
+#define EXIFSubjectDistance  0x9206 // Rational 1 Subject distance
+#define EXIFMeteringMode  0x9207 // Short 1 Metering mode
+#define EXIFLightSource  0x9208 // Short 1 Light source
+#define EXIFFlash  0x9209 // Short 1 Flash
+#define EXIFFocalLength  0x920A // Rational 1 Lens focal length
+#define EXIFSubjectArea  0x9214 // Short 2/3/2004 Subject area
+#define EXIFMakerNote  0x927C // Undefined Any Manufacturer notes
+#define EXIFUserComment  0x9286 // Undefined Any User comments
+#define EXIFSubSecTime  0x9290 // Ascii Any DateTime subseconds
+#define EXIFSubSecTimeOriginal  0x9291 // Ascii Any DateTimeOriginal subseconds
+#define EXIFSubSecTimeDigitized  0x9292 // Ascii Any DateTimeDigitized subseconds
+#define EXIFTemperature  0x9400 // SRational 1 Temperature
+#define EXIFHumidity  0x9401 // Rational 1 Humidity
+#define EXIFPressure  0x9402 // Rational 1 Pressure
+#define EXIFWaterDepth  0x9403 // SRational 1 Water Depth
+#define EXIFAcceleration  0x9404 // Rational 1 Acceleration
+#define EXIFCameraElevationAngle  0x9404 // SRational 1 Camera Elevation Angle
+#define EXIFFlashpixVersion  0xA000 // Undefined 4 Supported Flashpix version
+#define EXIFColorSpace  0xA001 // Short 1 Color space information
+#define EXIFPixelXDimension  0xA002 // Short/Long 1 Valid image width
+#define EXIFPixelYDimension  0xA003 // Short/Long 1 Valid image height
+#define EXIFRelatedSoundFile  0xA004 // Ascii 13 Related audio file
+#define EXIFInteroperability IFD Pointer  0xA005 // Long 1 Interoperability tag
+#define EXIFFlashEnergy  0xA20B // Rational 1 Flash energy
+#define EXIFSpatialFrequencyResponse  0xA20C // Undefined Any Spatial frequency response
+#define EXIFFocalPlaneXResolution  0xA20E // Rational 1 Focal plane X resolution
+#define EXIFFocalPlaneYResolution  0xA20F // Rational 1 Focal plane Y resolution
+#define EXIFFocalPlaneResolutionUnit  0xA210 // Short 1 Focal plane resolution unit
+#define EXIFSubjectLocation  0xA214 // Short 2 Subject location
+#define EXIFExposureIndex  0xA215 // Rational 1 Exposure index
+#define EXIFSensingMethod  0xA217 // Short 1 Sensing method
+#define EXIFFileSource  0xA300 // Undefined 1 File source
+#define EXIFSceneType  0xA301 // Undefined 1 Scene type
+#define EXIFCFAPattern  0xA302 // Undefined Any CFA pattern
+#define EXIFCustomRendered  0xA401 // Short 1 Custom image processing
+#define EXIFExposureMode  0xA402 // Short 1 Exposure mode
+#define EXIFWhiteBalance  0xA403 // Short 1 White balance
+#define EXIFDigitalZoomRatio  0xA404 // Rational 1 Digital zoom ratio
+#define EXIFFocalLengthIn35mmFilm  0xA405 // Short 1 Focal length in 35 mm film
+#define EXIFSceneCaptureType  0xA406 // Short 1 Scene capture type
+#define EXIFGainControl  0xA407 // Short 1 Gain control
+#define EXIFContrast  0xA408 // Short 1 Contrast
+#define EXIFSaturation  0xA409 // Short 1 Saturation
+#define EXIFSharpness  0xA40A // Short 1 Sharpness
+#define EXIFDeviceSettingDescription  0xA40B // Undefined Any Device settings description
+#define EXIFSubjectDistanceRange  0xA40C // Short 1 Subject distance range
+#define EXIFCompositeImage  0xA460 // Short 1 Composite Image
+#define EXIFSourceImageNumberOfCompositeImage 0xA461 // Short 1 Source Image Number Of Composite Image
+#define EXIFSourceExposureTimesOfCompositeImage 0xA462 // UNDEFINED aNY Source Exposure Times Of Composite Image
+#define EXIFImageUniqueID  0xA420 // Ascii 33 Unique image ID
+#define EXIFCameraOwnerName  0xA430 // Ascii Any Camera Owner Name
+#define EXIFBodySerialNumber  0xA431 // Ascii Any Body Serial Number
+#define EXIFLensSpecification  0xA432 // Rational 4 Lens Specification
+#define EXIFLensMake  0xA433 // Ascii Any Lens Make
+#define EXIFLensModel  0xA434 // Ascii Any Lens Model
+#define EXIFLensSerialNumber  0xA435 // Ascii Any Lens Serial Number
+#define EXIFGamma  0xA500 // Rational 1 Gamma
+
+//		Field		  Tag    // Data type Num Comment
+#define GPSVersionID  0x0000 // Byte      4   GPS tag version
+#define GPSLatitudeRef  0x0001 // Ascii 2 North or South Latitude
+#define GPSLatitude  0x0002 // Rational 3 Latitude
+#define GPSLongitudeRef  0x0003 // Ascii 2 East or West Longitude
+#define GPSLongitude  0x0004 // Rational 3 Longitude
+#define GPSAltitudeRef  0x0005 // Byte 1 Altitude reference
+#define GPSAltitude  0x0006 // Rational 1 Altitude
+#define GPSTimeStamp  0x0007 // Rational 3 GPS time (atomic clock)
+#define GPSSatellites  0x0008 // Ascii Any GPS satellites used for measurement
+#define GPSStatus  0x0009 // Ascii 2 GPS receiver status
+#define GPSMeasureMode  0x000A // Ascii 2 GPS measurement mode
+#define GPSDOP  0x000B // Rational 1 Measurement precision
+#define GPSSpeedRef  0x000C // Ascii 2 Speed unit
+#define GPSSpeed  0x000D // Rational 1 Speed of GPS receiver
+#define GPSTrackRef  0x000E // Ascii 2 Reference for direction of movement
+#define GPSTrack  0x000F // Rational 1 Direction of movement
+#define GPSImgDirectionRef  0x0010 // Ascii 2 Reference for direction of image
+#define GPSImgDirection  0x0011 // Rational 1 Direction of image
+#define GPSMapDatum  0x0012 // Ascii Any Geodetic survey data used
+#define GPSDestLatitudeRef  0x0013 // Ascii 2 Reference for latitude of destination
+#define GPSDestLatitude  0x0014 // Rational 3 Latitude of destination
+#define GPSDestLongitudeRef  0x0015 // Ascii 2 Reference for longitude of destination
+#define GPSDestLongitude  0x0016 // Rational 3 Longitude of destination
+#define GPSDestBearingRef  0x0017 // Ascii 2 Reference for bearing of destination
+#define GPSDestBearing  0x0018 // Rational 1 Bearing of destination
+#define GPSDestDistanceRef  0x0019 // Ascii 2 Reference for distance to destination
+#define GPSDestDistance  0x001A // Rational 1 Distance to destination
+#define GPSProcessingMethod  0x001B // Undefined Any Name of GPS processing method
+#define GPSAreaInformation  0x001C // Undefined Any Name of GPS area
+#define GPSDateStamp  0x001D // Ascii 11 GPS date
+#define GPSDifferential  0x001E // Short 1 GPS differential correction
+#define GPSHPositioningError  0x001F // Rational 1 Horizontal positioning error
+
+
 #endif // !JDEXIF_H
\ No newline at end of file
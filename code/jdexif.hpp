@@ -0,0 +1,380 @@
+#pragma once
+
+// jdexif.hpp gives C++ code typed access to the tags of a j_exif_ptr.  Each
+// tag of jdexif.h is described once in tagTable with its TIFF type, IFD and
+// count, and get<Tag>(ctx) is checked against that entry when it is
+// compiled: asking for a tag the table doesn't know is a compile error, and
+// the type of the value follows from the table instead of the caller.
+//
+//     auto when = jdexif::get<EXIFDateTimeOriginal>(ctx);  // std::string_view
+//     auto lat = jdexif::get<GPSLatitude>(ctx);            // std::array<jdexif::Rational, 3>
+//     auto iso = jdexif::get<EXIFPhotographicSensitivity>(ctx);  // jdexif::Values<TIFF_TYPE_SHORT>
+//
+// get returns a std::optional that is empty if the tag is not in the file,
+// has another type than the table gives, or has fewer values than a fixed
+// count.  The value is decoded straight from the APP1 segment with the byte
+// order known: ASCII tags are a std::string_view into the segment, tags
+// with a count of up to 8 are a value or a std::array of values, and other
+// tags are a Values view that decodes an element when it is read.  Views
+// are valid until the next file is read into ctx.  Only the tags the
+// standard lets be SHORT or LONG look at the stored type to decode.
+//
+// Include jpeglib.h before this file, as for jdexif.h.  C++17 is needed.
+
+#ifndef JDEXIF_HPP
+#define JDEXIF_HPP
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+
+#include "jdexif.h"
+
+namespace jdexif {
+
+// TIFF_TYPE_SHORT_OR_LONG stands in tagTable for tags that may be either.
+constexpr uint16_t TIFF_TYPE_SHORT_OR_LONG = 0x100;
+
+// A TagDef describes a tag as the EXIF 2.3 standard defines it.  A count
+// of 0 is any count.
+struct TagDef {
+	uint16_t tag;
+	uint16_t ifd;    // EXIF_IFD_ value the tag belongs to
+	uint16_t type;   // TIFF_TYPE_ value, or TIFF_TYPE_SHORT_OR_LONG
+	uint32_t count;
+};
+
+// The tags that point to the Exif and GPS IFDs are left out: the parser
+// follows them and doesn't keep them as tags.
+inline constexpr TagDef tagTable[] = {
+	{ TIFFImageWidth, EXIF_IFD_0, TIFF_TYPE_SHORT_OR_LONG, 1 },
+	{ TIFFImageLength, EXIF_IFD_0, TIFF_TYPE_SHORT_OR_LONG, 1 },
+	{ TIFFBitsPerSample, EXIF_IFD_0, TIFF_TYPE_SHORT, 3 },
+	{ TIFFCompression, EXIF_IFD_0, TIFF_TYPE_SHORT, 1 },
+	{ TIFFPhotometricInterpretation, EXIF_IFD_0, TIFF_TYPE_SHORT, 1 },
+	{ TIFFImageDescription, EXIF_IFD_0, TIFF_TYPE_ASCII, 0 },
+	{ TIFFMake, EXIF_IFD_0, TIFF_TYPE_ASCII, 0 },
+	{ TIFFModel, EXIF_IFD_0, TIFF_TYPE_ASCII, 0 },
+	{ TIFFStripOffsets, EXIF_IFD_0, TIFF_TYPE_SHORT_OR_LONG, 0 },
+	{ TIFFOrientation, EXIF_IFD_0, TIFF_TYPE_SHORT, 1 },
+	{ TIFFSamplesPerPixel, EXIF_IFD_0, TIFF_TYPE_SHORT, 1 },
+	{ TIFFRowsPerStrip, EXIF_IFD_0, TIFF_TYPE_SHORT_OR_LONG, 1 },
+	{ TIFFStripByteCounts, EXIF_IFD_0, TIFF_TYPE_SHORT_OR_LONG, 0 },
+	{ TIFFXResolution, EXIF_IFD_0, TIFF_TYPE_RATIONAL, 1 },
+	{ TIFFYResolution, EXIF_IFD_0, TIFF_TYPE_RATIONAL, 1 },
+	{ TIFFPlanarConfiguration, EXIF_IFD_0, TIFF_TYPE_SHORT, 1 },
+	{ TIFFResolutionUnit, EXIF_IFD_0, TIFF_TYPE_SHORT, 1 },
+	{ TIFFTransferFunction, EXIF_IFD_0, TIFF_TYPE_SHORT, 768 },
+	{ TIFFSoftware, EXIF_IFD_0, TIFF_TYPE_ASCII, 0 },
+	{ TIFFDateTime, EXIF_IFD_0, TIFF_TYPE_ASCII, 20 },
+	{ TIFFArtist, EXIF_IFD_0, TIFF_TYPE_ASCII, 0 },
+	{ TIFFWhitePoint, EXIF_IFD_0, TIFF_TYPE_RATIONAL, 2 },
+	{ TIFFPrimaryChromaticities, EXIF_IFD_0, TIFF_TYPE_RATIONAL, 6 },
+	{ TIFFJPEGInterchangeFormat, EXIF_IFD_1, TIFF_TYPE_LONG, 1 },
+	{ TIFFJPEGInterchangeFormatLength, EXIF_IFD_1, TIFF_TYPE_LONG, 1 },
+	{ TIFFYCbCrCoefficients, EXIF_IFD_0, TIFF_TYPE_RATIONAL, 3 },
+	{ TIFFYCbCrSubSampling, EXIF_IFD_0, TIFF_TYPE_SHORT, 2 },
+	{ TIFFYCbCrPositioning, EXIF_IFD_0, TIFF_TYPE_SHORT, 1 },
+	{ TIFFReferenceBlackWhite, EXIF_IFD_0, TIFF_TYPE_RATIONAL, 6 },
+	{ TIFFCopyright, EXIF_IFD_0, TIFF_TYPE_ASCII, 0 },
+	{ EXIFExposureTime, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFFNumber, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFExposureProgram, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFSpectralSensitivity, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 0 },
+	{ EXIFPhotographicSensitivity, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 0 },
+	{ EXIFOECF, EXIF_IFD_EXIF, TIFF_TYPE_UNDEFINED, 0 },
+	{ EXIFSensitivityType, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFStandardOutputSensitivity, EXIF_IFD_EXIF, TIFF_TYPE_LONG, 1 },
+	{ EXIFRecommendedExposureIndex, EXIF_IFD_EXIF, TIFF_TYPE_LONG, 1 },
+	{ EXIFISOSpeed, EXIF_IFD_EXIF, TIFF_TYPE_LONG, 1 },
+	{ EXIFISOSpeedLatitudeyyy, EXIF_IFD_EXIF, TIFF_TYPE_LONG, 1 },
+	{ EXIFISOSpeedLatitudezzz, EXIF_IFD_EXIF, TIFF_TYPE_LONG, 1 },
+	{ EXIFExifVersion, EXIF_IFD_EXIF, TIFF_TYPE_UNDEFINED, 4 },
+	{ EXIFDateTimeOriginal, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 20 },
+	{ EXIFDateTimeDigitized, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 20 },
+	{ EXIFOffsetTime, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 7 },
+	{ EXIFOffsetTimeOriginal, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 7 },
+	{ EXIFOffsetTimeDigitized, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 7 },
+	{ EXIFComponentsConfiguration, EXIF_IFD_EXIF, TIFF_TYPE_UNDEFINED, 4 },
+	{ EXIFCompressedBitsPerPixel, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFShutterSpeedValue, EXIF_IFD_EXIF, TIFF_TYPE_SRATIONAL, 1 },
+	{ EXIFApertureValue, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFBrightnessValue, EXIF_IFD_EXIF, TIFF_TYPE_SRATIONAL, 1 },
+	{ EXIFExposureBiasValue, EXIF_IFD_EXIF, TIFF_TYPE_SRATIONAL, 1 },
+	{ EXIFMaxApertureValue, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFSubjectDistance, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFMeteringMode, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFLightSource, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFFlash, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFFocalLength, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFSubjectArea, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 0 },
+	{ EXIFMakerNote, EXIF_IFD_EXIF, TIFF_TYPE_UNDEFINED, 0 },
+	{ EXIFUserComment, EXIF_IFD_EXIF, TIFF_TYPE_UNDEFINED, 0 },
+	{ EXIFSubSecTime, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 0 },
+	{ EXIFSubSecTimeOriginal, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 0 },
+	{ EXIFSubSecTimeDigitized, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 0 },
+	{ EXIFTemperature, EXIF_IFD_EXIF, TIFF_TYPE_SRATIONAL, 1 },
+	{ EXIFHumidity, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFPressure, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFWaterDepth, EXIF_IFD_EXIF, TIFF_TYPE_SRATIONAL, 1 },
+	{ EXIFAcceleration, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFFlashpixVersion, EXIF_IFD_EXIF, TIFF_TYPE_UNDEFINED, 4 },
+	{ EXIFColorSpace, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFPixelXDimension, EXIF_IFD_EXIF, TIFF_TYPE_SHORT_OR_LONG, 1 },
+	{ EXIFPixelYDimension, EXIF_IFD_EXIF, TIFF_TYPE_SHORT_OR_LONG, 1 },
+	{ EXIFRelatedSoundFile, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 13 },
+	{ EXIFFlashEnergy, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFSpatialFrequencyResponse, EXIF_IFD_EXIF, TIFF_TYPE_UNDEFINED, 0 },
+	{ EXIFFocalPlaneXResolution, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFFocalPlaneYResolution, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFFocalPlaneResolutionUnit, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFSubjectLocation, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 2 },
+	{ EXIFExposureIndex, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFSensingMethod, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFFileSource, EXIF_IFD_EXIF, TIFF_TYPE_UNDEFINED, 1 },
+	{ EXIFSceneType, EXIF_IFD_EXIF, TIFF_TYPE_UNDEFINED, 1 },
+	{ EXIFCFAPattern, EXIF_IFD_EXIF, TIFF_TYPE_UNDEFINED, 0 },
+	{ EXIFCustomRendered, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFExposureMode, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFWhiteBalance, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFDigitalZoomRatio, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ EXIFFocalLengthIn35mmFilm, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFSceneCaptureType, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFGainControl, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFContrast, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFSaturation, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFSharpness, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFDeviceSettingDescription, EXIF_IFD_EXIF, TIFF_TYPE_UNDEFINED, 0 },
+	{ EXIFSubjectDistanceRange, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFCompositeImage, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFSourceImageNumberOfCompositeImage, EXIF_IFD_EXIF, TIFF_TYPE_SHORT, 1 },
+	{ EXIFSourceExposureTimesOfCompositeImage, EXIF_IFD_EXIF, TIFF_TYPE_UNDEFINED, 0 },
+	{ EXIFImageUniqueID, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 33 },
+	{ EXIFCameraOwnerName, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 0 },
+	{ EXIFBodySerialNumber, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 0 },
+	{ EXIFLensSpecification, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 4 },
+	{ EXIFLensMake, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 0 },
+	{ EXIFLensModel, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 0 },
+	{ EXIFLensSerialNumber, EXIF_IFD_EXIF, TIFF_TYPE_ASCII, 0 },
+	{ EXIFGamma, EXIF_IFD_EXIF, TIFF_TYPE_RATIONAL, 1 },
+	{ GPSVersionID, EXIF_IFD_GPS, TIFF_TYPE_BYTE, 4 },
+	{ GPSLatitudeRef, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 2 },
+	{ GPSLatitude, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 3 },
+	{ GPSLongitudeRef, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 2 },
+	{ GPSLongitude, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 3 },
+	{ GPSAltitudeRef, EXIF_IFD_GPS, TIFF_TYPE_BYTE, 1 },
+	{ GPSAltitude, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 1 },
+	{ GPSTimeStamp, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 3 },
+	{ GPSSatellites, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 0 },
+	{ GPSStatus, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 2 },
+	{ GPSMeasureMode, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 2 },
+	{ GPSDOP, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 1 },
+	{ GPSSpeedRef, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 2 },
+	{ GPSSpeed, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 1 },
+	{ GPSTrackRef, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 2 },
+	{ GPSTrack, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 1 },
+	{ GPSImgDirectionRef, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 2 },
+	{ GPSImgDirection, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 1 },
+	{ GPSMapDatum, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 0 },
+	{ GPSDestLatitudeRef, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 2 },
+	{ GPSDestLatitude, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 3 },
+	{ GPSDestLongitudeRef, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 2 },
+	{ GPSDestLongitude, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 3 },
+	{ GPSDestBearingRef, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 2 },
+	{ GPSDestBearing, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 1 },
+	{ GPSDestDistanceRef, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 2 },
+	{ GPSDestDistance, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 1 },
+	{ GPSProcessingMethod, EXIF_IFD_GPS, TIFF_TYPE_UNDEFINED, 0 },
+	{ GPSAreaInformation, EXIF_IFD_GPS, TIFF_TYPE_UNDEFINED, 0 },
+	{ GPSDateStamp, EXIF_IFD_GPS, TIFF_TYPE_ASCII, 11 },
+	{ GPSDifferential, EXIF_IFD_GPS, TIFF_TYPE_SHORT, 1 },
+	{ GPSHPositioningError, EXIF_IFD_GPS, TIFF_TYPE_RATIONAL, 1 },
+};
+
+struct Rational {
+	uint32_t num;
+	uint32_t den;
+	// value is 0 if den is 0, as exifRationalData_r returns it
+	constexpr double value() const { return den == 0 ? 0.0 : (double)num / (double)den; }
+};
+
+struct SRational {
+	int32_t num;
+	int32_t den;
+	constexpr double value() const { return den == 0 ? 0.0 : (double)num / (double)den; }
+};
+
+namespace detail {
+
+inline uint16_t load16(const uint8_t* p, bool bigEndian) {
+	return bigEndian ? (uint16_t)((p[0] << 8) | p[1]) : (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t load32(const uint8_t* p, bool bigEndian) {
+	return bigEndian ? ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]
+		: p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Format<Type> gives the C++ type of the values of a table type, which
+// stored types it accepts and how to read value i.
+template<uint16_t Type> struct Format;
+
+template<> struct Format<TIFF_TYPE_BYTE> {
+	using type = uint8_t;
+	static constexpr bool accepts(uint16_t t) { return t == TIFF_TYPE_BYTE || t == TIFF_TYPE_UNDEFINED; }
+	static type load(const uint8_t* p, uint32_t i, bool, uint16_t) { return p[i]; }
+};
+
+template<> struct Format<TIFF_TYPE_UNDEFINED> : Format<TIFF_TYPE_BYTE> {};
+
+template<> struct Format<TIFF_TYPE_ASCII> {
+	using type = char;
+	static constexpr bool accepts(uint16_t t) { return t == TIFF_TYPE_ASCII; }
+};
+
+template<> struct Format<TIFF_TYPE_SHORT> {
+	using type = uint16_t;
+	static constexpr bool accepts(uint16_t t) { return t == TIFF_TYPE_SHORT; }
+	static type load(const uint8_t* p, uint32_t i, bool bigEndian, uint16_t) { return load16(p + 2 * i, bigEndian); }
+};
+
+template<> struct Format<TIFF_TYPE_LONG> {
+	using type = uint32_t;
+	static constexpr bool accepts(uint16_t t) { return t == TIFF_TYPE_LONG; }
+	static type load(const uint8_t* p, uint32_t i, bool bigEndian, uint16_t) { return load32(p + 4 * i, bigEndian); }
+};
+
+template<> struct Format<TIFF_TYPE_SHORT_OR_LONG> {
+	using type = uint32_t;
+	static constexpr bool accepts(uint16_t t) { return t == TIFF_TYPE_SHORT || t == TIFF_TYPE_LONG; }
+	static type load(const uint8_t* p, uint32_t i, bool bigEndian, uint16_t stored) {
+		return stored == TIFF_TYPE_SHORT ? load16(p + 2 * i, bigEndian) : load32(p + 4 * i, bigEndian);
+	}
+};
+
+template<> struct Format<TIFF_TYPE_SLONG> {
+	using type = int32_t;
+	static constexpr bool accepts(uint16_t t) { return t == TIFF_TYPE_SLONG; }
+	static type load(const uint8_t* p, uint32_t i, bool bigEndian, uint16_t) { return (int32_t)load32(p + 4 * i, bigEndian); }
+};
+
+template<> struct Format<TIFF_TYPE_RATIONAL> {
+	using type = Rational;
+	static constexpr bool accepts(uint16_t t) { return t == TIFF_TYPE_RATIONAL; }
+	static type load(const uint8_t* p, uint32_t i, bool bigEndian, uint16_t) {
+		return { load32(p + 8 * i, bigEndian), load32(p + 8 * i + 4, bigEndian) };
+	}
+};
+
+template<> struct Format<TIFF_TYPE_SRATIONAL> {
+	using type = SRational;
+	static constexpr bool accepts(uint16_t t) { return t == TIFF_TYPE_SRATIONAL; }
+	static type load(const uint8_t* p, uint32_t i, bool bigEndian, uint16_t) {
+		return { (int32_t)load32(p + 8 * i, bigEndian), (int32_t)load32(p + 8 * i + 4, bigEndian) };
+	}
+};
+
+// tagIndex returns the index of a tag or EXIF_IFD_KEY in tagTable, or -1.
+// A key may name IFD1 for the tags of IFD0, which it shares.
+constexpr int tagIndex(uint32_t key) {
+	uint32_t ifd = key >> 16;
+	for (size_t i = 0; i < sizeof(tagTable) / sizeof(tagTable[0]); i++) {
+		const TagDef& def = tagTable[i];
+		if (def.tag != (uint16_t)key) continue;
+		if (ifd == EXIF_IFD_ANY || ifd == def.ifd) return (int)i;
+		if ((ifd == EXIF_IFD_0 || ifd == EXIF_IFD_1) && (def.ifd == EXIF_IFD_0 || def.ifd == EXIF_IFD_1)) return (int)i;
+	}
+	return -1;
+}
+
+} // namespace detail
+
+// Values is a view of the values of a tag in the APP1 segment.  Elements
+// are decoded in the file's byte order when they are read.
+template<uint16_t Type>
+class Values {
+public:
+	using value_type = typename detail::Format<Type>::type;
+
+	class iterator {
+	public:
+		iterator(const Values* values, uint32_t i) : values(values), i(i) {}
+		value_type operator*() const { return (*values)[i]; }
+		iterator& operator++() { i++; return *this; }
+		bool operator==(const iterator& other) const { return i == other.i; }
+		bool operator!=(const iterator& other) const { return i != other.i; }
+	private:
+		const Values* values;
+		uint32_t i;
+	};
+
+	Values(const uint8_t* data, uint32_t count, bool bigEndian, uint16_t stored)
+		: p(data), n(count), bigEndian(bigEndian), stored(stored) {}
+
+	uint32_t size() const { return n; }
+	bool empty() const { return n == 0; }
+	value_type operator[](uint32_t i) const { return detail::Format<Type>::load(p, i, bigEndian, stored); }
+	iterator begin() const { return iterator(this, 0); }
+	iterator end() const { return iterator(this, n); }
+	// data is the raw bytes in the segment
+	const uint8_t* data() const { return p; }
+
+private:
+	const uint8_t* p;
+	uint32_t n;
+	bool bigEndian;
+	uint16_t stored;
+};
+
+// Tag<Key> is what the table says of a tag, and the type get<Key> returns.
+template<uint32_t Key>
+struct Tag {
+	static constexpr int index = detail::tagIndex(Key);
+	static_assert(index >= 0, "the tag is not in jdexif::tagTable, or not in that IFD");
+	static constexpr TagDef def = tagTable[index < 0 ? 0 : index];
+	// key is what is looked up: the IFD of the table unless Key gives one
+	static constexpr uint32_t key = EXIF_IFD_KEY((Key >> 16) != EXIF_IFD_ANY ? (Key >> 16) : def.ifd, def.tag);
+	using element_type = typename detail::Format<def.type>::type;
+	using value_type = std::conditional_t<def.type == TIFF_TYPE_ASCII, std::string_view,
+		std::conditional_t<def.count == 1, element_type,
+		std::conditional_t<def.count != 0 && def.count <= 8, std::array<element_type, def.count>,
+		Values<def.type>>>>;
+};
+
+// get returns the value of a tag of ctx, see the top of this file.
+template<uint32_t Key>
+std::optional<typename Tag<Key>::value_type> get(j_exif_ptr ctx) {
+	using T = Tag<Key>;
+	using F = detail::Format<T::def.type>;
+	using V = typename T::value_type;
+	uint16_t type;
+	const uint8_t* data;
+	int count = exifRawData_r(ctx, T::key, &type, &data);
+	if (count <= 0 || !F::accepts(type)) return std::nullopt;
+	uint32_t n = (uint32_t)count;
+	if constexpr (T::def.type == TIFF_TYPE_ASCII) {
+		// the value ends at the first 0, which is usually its last byte
+		const char* s = (const char*)data;
+		const void* end = std::memchr(s, 0, n);
+		return std::string_view(s, end != nullptr ? (size_t)((const char*)end - s) : n);
+	} else {
+		bool bigEndian = exifBigEndian_r(ctx) != FALSE;
+		if constexpr (std::is_same_v<V, Values<T::def.type>>) {
+			return V(data, n, bigEndian, type);
+		} else if constexpr (T::def.count == 1) {
+			return F::load(data, 0, bigEndian, type);
+		} else {
+			if (n < T::def.count) return std::nullopt;
+			V values;
+			for (uint32_t i = 0; i < T::def.count; i++) values[i] = F::load(data, i, bigEndian, type);
+			return values;
+		}
+	}
+}
+
+} // namespace jdexif
+
+#endif // !JDEXIF_HPP
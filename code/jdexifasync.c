@@ -0,0 +1,454 @@
+#include <stdio.h>
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdexif.h"
+#include "jdexifint.h"
+
+// This file implements the asynchronous reader.  A reader has depth slots,
+// each with a buffer for the first bytes of a file.  Every slot that is
+// free is given the next path, and the file is opened and its prefix read
+// without waiting; the caller's thread takes the slots in the order their
+// reads complete, parses the prefix with exifParseBuffer, and hands ctx to
+// the callback before the slot gets the next path.  So up to depth files
+// are being read while one is parsed, which keeps the queue of the device
+// full on NVMe and on network file systems.
+//
+// With EXIF_USE_IO_URING defined (and -luring), the opens and reads are
+// submitted to an io_uring.  Otherwise, or if the kernel refuses the ring,
+// depth threads open and pread the files.  If the ring fails in the middle
+// of a batch, what it has in flight is cancelled and waited for, and the
+// threads read the rest.  Where there are neither, files are parsed one at
+// a time with exifParseFile.
+//
+// Reads are repeated until the prefix is full or the file ends.  A file
+// whose markers run on past the prefix before the EXIF segment is complete,
+// or before SOS when ctx captures metadata segments, is parsed again from
+// the file with exifParseFile.
+
+#if defined(__unix__) || defined(__APPLE__)
+#define USE_THREADS  /* read the files with a thread per slot */
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+#if defined(EXIF_USE_IO_URING) && defined(__linux__)
+#define USE_IO_URING  /* read the files through an io_uring */
+#include <liburing.h>
+#endif
+
+// the defaults of exifAsyncCreate: an APP1 segment is at most 64 KB, and
+// APP0 and a few small segments usually come before it
+#define DEFAULT_DEPTH 64
+#define DEFAULT_PREFIX (72 * 1024)
+
+#define M_SOI   0xD8
+#define M_EOI   0xD9
+#define M_SOS   0xDA
+#define M_TEM   0x01
+#define M_RST0  0xD0
+#define M_RST7  0xD7
+
+#define SLOT_FREE 0
+#define SLOT_OPENING 1
+#define SLOT_READING 2
+#define SLOT_DONE 3
+
+struct async_slot {
+	uint8_t* buf;
+	size_t index;   // of the path in the batch
+	int fd;
+	int state;      // SLOT_ value
+	ssize_t length; // bytes read, or -1 if the file couldn't be read
+	boolean whole;  // the file ended within the prefix
+};
+
+struct exif_async {
+	int depth;
+	size_t prefix;
+	struct async_slot* slots;
+	boolean slotsLost;      // the ring may still write the buffers; they aren't used again
+	size_t first;           // index in the caller's paths of the first path of the batch
+	uint64_t bytesRead;
+#ifdef USE_IO_URING
+	struct io_uring ring;
+	boolean ringReady;
+	boolean ringFailed;     // the ring returned an error and isn't used
+#endif
+#ifdef USE_THREADS
+	// the batch the threads are working on
+	pthread_mutex_t lock;
+	pthread_cond_t taken;   // a slot was parsed and is free again
+	pthread_cond_t ready;   // a slot has been read
+	const char* const* paths;
+	size_t numPaths;
+	size_t next;            // the next path to give to a thread
+	int* readyQueue;        // of the slots that have been read
+	int readyHead;
+	int readyCount;
+	int running;            // threads still working
+#endif
+};
+
+struct async_thread {
+	j_exif_async async;
+	int slot;
+};
+
+GLOBAL(j_exif_async)
+exifAsyncCreate(int depth, size_t prefix) {
+	if (depth < 0) return NULL;
+	j_exif_async async = (j_exif_async)exifAlloc(sizeof(struct exif_async));
+	if (async == NULL) return NULL;
+	memset(async, 0, sizeof(struct exif_async));
+	async->depth = depth > 0 ? depth : DEFAULT_DEPTH;
+	async->prefix = prefix > 0 ? prefix : DEFAULT_PREFIX;
+	async->slots = (struct async_slot*)exifAlloc(async->depth * sizeof(struct async_slot));
+	boolean ok = async->slots != NULL;
+	if (ok) memset(async->slots, 0, async->depth * sizeof(struct async_slot));
+	for (int i = 0; ok && i < async->depth; i++) {
+		async->slots[i].buf = (uint8_t*)exifAlloc(async->prefix);
+		ok = async->slots[i].buf != NULL;
+	}
+#ifdef USE_THREADS
+	if (ok) {
+		async->readyQueue = (int*)exifAlloc(async->depth * sizeof(int));
+		ok = async->readyQueue != NULL;
+	}
+#endif
+	if (!ok) {
+		exifAsyncDestroy(async);
+		return NULL;
+	}
+#ifdef USE_IO_URING
+	// without a ring, as under seccomp or old kernels, threads do the reads
+	async->ringReady = io_uring_queue_init((unsigned)async->depth, &async->ring, 0) == 0;
+#endif
+	return async;
+}
+
+GLOBAL(void)
+exifAsyncDestroy(j_exif_async async) {
+	if (async == NULL) return;
+#ifdef USE_IO_URING
+	if (async->ringReady) io_uring_queue_exit(&async->ring);
+#endif
+	if (async->slots != NULL && !async->slotsLost) {
+		for (int i = 0; i < async->depth; i++) exifFree(async->slots[i].buf);
+	}
+	exifFree(async->slots);
+#ifdef USE_THREADS
+	exifFree(async->readyQueue);
+#endif
+	exifFree(async);
+}
+
+GLOBAL(uint64_t)
+exifAsyncBytesRead(j_exif_async async) {
+	return async->bytesRead;
+}
+
+// prefixCut tells if the markers of the JPEG file that starts with the
+// length bytes at buf run on past them, before SOS or EOI.  The rest of the
+// file may then hold segments that were not read.
+LOCAL(boolean)
+prefixCut(const uint8_t* buf, size_t length) {
+	size_t pos = 2;
+	if (length < 2 || buf[0] != 0xFF || buf[1] != M_SOI) return FALSE;  // not a JPEG file
+	for (;;) {
+		if (pos >= length) return TRUE;
+		if (buf[pos++] != 0xFF) return FALSE;  // lost sync, as exifParseBuffer did
+		while (pos < length && buf[pos] == 0xFF) pos++;  // fill bytes
+		if (pos >= length) return TRUE;
+		int marker = buf[pos++];
+		if (marker == M_SOS || marker == M_EOI) return FALSE;
+		if (marker == M_TEM || (marker >= M_RST0 && marker <= M_RST7)) continue;
+		if (length - pos < 2) return TRUE;
+		size_t segment = (size_t)buf[pos] << 8 | buf[pos + 1];
+		if (segment < 2) return FALSE;
+		if (segment > length - pos) return TRUE;
+		pos += segment;
+	}
+}
+
+// asyncParse parses the prefix read into slot and gives ctx to done.  If
+// the file goes on past the prefix, and what is needed may be in the part
+// that wasn't read, the file is read again the usual way.
+LOCAL(void)
+asyncParse(j_exif_async async, j_exif_ptr ctx, struct async_slot* slot, const char* path,
+		exif_async_done done, void* user) {
+	int result;
+	if (slot->length < 0) {
+		result = exifParseBuffer(ctx, NULL, 0);  // clears ctx
+	} else {
+		async->bytesRead += (uint64_t)slot->length;
+		result = exifParseBuffer(ctx, slot->buf, (size_t)slot->length);
+		if (!slot->whole && (result != 1 || exifCapturesMetadata_r(ctx)) &&
+				prefixCut(slot->buf, (size_t)slot->length)) {
+			result = exifParseFile(ctx, path);
+			async->bytesRead += exifBytesRead_r(ctx);
+		}
+	}
+	done(ctx, async->first + slot->index, result, user);
+}
+
+#ifdef USE_IO_URING
+// ringRead queues the read of the rest of the prefix of slot, to be
+// submitted with the next opens.
+LOCAL(boolean)
+ringRead(j_exif_async async, struct async_slot* slot) {
+	struct io_uring_sqe* sqe = io_uring_get_sqe(&async->ring);
+	if (sqe == NULL) return FALSE;
+	io_uring_prep_read(sqe, slot->fd, slot->buf + slot->length, (unsigned)(async->prefix - (size_t)slot->length),
+		(uint64_t)slot->length);
+	io_uring_sqe_set_data(sqe, slot);
+	slot->state = SLOT_READING;
+	return TRUE;
+}
+
+// ringDrain cancels the opens and reads the ring still has for the slots
+// and waits for all of them to complete, closing the files they opened.
+// Then no buffer is written behind the reader's back.  The slots are left
+// done, to be parsed some other way.  Returns FALSE if the ring can't even
+// do that, when the slots that are not done may still be written.
+LOCAL(boolean)
+ringDrain(j_exif_async async) {
+	struct io_uring* ring = &async->ring;
+	int pending = 0;
+	for (int i = 0; i < async->depth; i++) {
+		struct async_slot* slot = &async->slots[i];
+		if (slot->state != SLOT_OPENING && slot->state != SLOT_READING) continue;
+		// an operation that the failed submission left in the queue is
+		// submitted with the cancels, and completes like the rest
+		struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+		if (sqe != NULL) {
+			io_uring_prep_cancel(sqe, slot, 0);
+			io_uring_sqe_set_data(sqe, NULL);
+		}
+		pending++;
+	}
+	while (pending > 0) {
+		int submitted = io_uring_submit_and_wait(ring, 1);
+		if (submitted < 0 && submitted != -EINTR && submitted != -EAGAIN && submitted != -EBUSY) {
+			// a read in flight holds the file itself, so its descriptor can go
+			for (int i = 0; i < async->depth; i++) {
+				if (async->slots[i].state == SLOT_READING) close(async->slots[i].fd);
+			}
+			return FALSE;
+		}
+		struct io_uring_cqe* cqe;
+		while (io_uring_peek_cqe(ring, &cqe) == 0) {
+			struct async_slot* slot = (struct async_slot*)io_uring_cqe_get_data(cqe);
+			int res = cqe->res;
+			io_uring_cqe_seen(ring, cqe);
+			if (slot == NULL) continue;  // the result of a cancel
+			if (slot->state == SLOT_OPENING && res >= 0) close(res);
+			else if (slot->state == SLOT_READING) close(slot->fd);
+			slot->state = SLOT_DONE;
+			pending--;
+		}
+	}
+	return TRUE;
+}
+
+// asyncRing reads the files through the ring.  Every slot goes from
+// opening to reading to free, and is read again after a short read until
+// the prefix is full or a read returns 0 at the end of the file.  If the
+// ring fails, what it has in flight is drained, the files it had started
+// are parsed with exifParseFile, and the reader doesn't use the ring
+// again.  Returns the number of paths from the first that are finished.
+LOCAL(size_t)
+asyncRing(j_exif_async async, j_exif_ptr ctx, const char* const* paths, size_t numPaths,
+		exif_async_done done, void* user) {
+	struct io_uring* ring = &async->ring;
+	size_t next = 0, finished = 0;
+	while (finished < numPaths) {
+		for (int i = 0; i < async->depth && next < numPaths; i++) {
+			struct async_slot* slot = &async->slots[i];
+			if (slot->state != SLOT_FREE) continue;
+			struct io_uring_sqe* sqe = io_uring_get_sqe(ring);
+			if (sqe == NULL) break;
+			io_uring_prep_openat(sqe, AT_FDCWD, paths[next], O_RDONLY | O_CLOEXEC, 0);
+			io_uring_sqe_set_data(sqe, slot);
+			slot->index = next++;
+			slot->state = SLOT_OPENING;
+		}
+		int submitted = io_uring_submit_and_wait(ring, 1);
+		if (submitted == -EINTR) continue;
+		if (submitted < 0) {
+			async->ringFailed = TRUE;
+			break;
+		}
+		struct io_uring_cqe* cqe;
+		while (io_uring_peek_cqe(ring, &cqe) == 0) {
+			struct async_slot* slot = (struct async_slot*)io_uring_cqe_get_data(cqe);
+			int res = cqe->res;
+			io_uring_cqe_seen(ring, cqe);
+			if (slot->state == SLOT_OPENING) {
+				slot->fd = res;
+				slot->length = 0;
+				slot->whole = FALSE;
+				if (res >= 0 && ringRead(async, slot)) continue;
+				if (res >= 0) close(slot->fd);
+				slot->length = -1;
+			} else {
+				if (res > 0) slot->length += res;
+				if (res > 0 && (size_t)slot->length < async->prefix && ringRead(async, slot)) continue;
+				close(slot->fd);
+				slot->whole = res == 0;
+				if (res < 0) slot->length = -1;
+			}
+			asyncParse(async, ctx, slot, paths[slot->index], done, user);
+			slot->state = SLOT_FREE;
+			finished++;
+		}
+	}
+	if (finished == numPaths) return finished;
+	async->slotsLost = !ringDrain(async);
+	for (int i = 0; i < async->depth; i++) {
+		struct async_slot* slot = &async->slots[i];
+		if (slot->state == SLOT_FREE) continue;
+		int result = exifParseFile(ctx, paths[slot->index]);
+		async->bytesRead += exifBytesRead_r(ctx);
+		done(ctx, slot->index, result, user);
+		slot->state = SLOT_FREE;
+	}
+	return next;
+}
+#endif
+
+#ifdef USE_THREADS
+// asyncThread reads files into its slot until there are no paths left.
+// After each file it waits for the slot to be parsed.
+static void*
+asyncThread(void* arg) {
+	struct async_thread* self = (struct async_thread*)arg;
+	j_exif_async async = self->async;
+	struct async_slot* slot = &async->slots[self->slot];
+	pthread_mutex_lock(&async->lock);
+	for (;;) {
+		while (slot->state != SLOT_FREE) pthread_cond_wait(&async->taken, &async->lock);
+		if (async->next >= async->numPaths) break;
+		slot->index = async->next++;
+		slot->state = SLOT_READING;
+		const char* path = async->paths[slot->index];
+		pthread_mutex_unlock(&async->lock);
+
+		ssize_t length = -1;
+		boolean whole = FALSE;
+		int fd = open(path, O_RDONLY);
+		if (fd >= 0) {
+			// a short read is only the end of the file if the next returns 0
+			length = 0;
+			while ((size_t)length < async->prefix) {
+				ssize_t got = pread(fd, slot->buf + length, async->prefix - (size_t)length, (off_t)length);
+				if (got < 0 && errno == EINTR) continue;
+				if (got <= 0) {
+					whole = got == 0;
+					if (got < 0) length = -1;
+					break;
+				}
+				length += got;
+			}
+			close(fd);
+		}
+		slot->length = length;
+		slot->whole = whole;
+
+		pthread_mutex_lock(&async->lock);
+		slot->state = SLOT_DONE;
+		async->readyQueue[(async->readyHead + async->readyCount++) % async->depth] = self->slot;
+		pthread_cond_signal(&async->ready);
+	}
+	async->running--;
+	pthread_cond_signal(&async->ready);
+	pthread_mutex_unlock(&async->lock);
+	return NULL;
+}
+
+// asyncThreads reads the files with a thread per slot, and parses them on
+// the caller's thread as they are read.
+LOCAL(size_t)
+asyncThreads(j_exif_async async, j_exif_ptr ctx, const char* const* paths, size_t numPaths,
+		exif_async_done done, void* user) {
+	int numThreads = numPaths < (size_t)async->depth ? (int)numPaths : async->depth;
+	struct async_thread* threads = (struct async_thread*)exifAlloc(numThreads * sizeof(struct async_thread));
+	pthread_t* ids = (pthread_t*)exifAlloc(numThreads * sizeof(pthread_t));
+	size_t finished = 0;
+	if (threads == NULL || ids == NULL) {
+		exifFree(threads);
+		exifFree(ids);
+		return (size_t)-1;
+	}
+	pthread_mutex_init(&async->lock, NULL);
+	pthread_cond_init(&async->taken, NULL);
+	pthread_cond_init(&async->ready, NULL);
+	async->paths = paths;
+	async->numPaths = numPaths;
+	async->next = 0;
+	async->readyHead = async->readyCount = 0;
+	async->running = 0;
+	pthread_mutex_lock(&async->lock);
+	for (int i = 0; i < numThreads; i++) {
+		threads[i].async = async;
+		threads[i].slot = i;
+		async->slots[i].state = SLOT_FREE;
+		if (pthread_create(&ids[i], NULL, asyncThread, &threads[i]) != 0) break;
+		async->running++;
+	}
+	int started = async->running;
+	if (started == 0) {
+		// no threads; read the files here instead
+		pthread_mutex_unlock(&async->lock);
+		finished = (size_t)-1;
+	} else {
+		for (;;) {
+			while (async->readyCount == 0 && async->running > 0) pthread_cond_wait(&async->ready, &async->lock);
+			if (async->readyCount == 0) break;
+			struct async_slot* slot = &async->slots[async->readyQueue[async->readyHead]];
+			async->readyHead = (async->readyHead + 1) % async->depth;
+			async->readyCount--;
+			pthread_mutex_unlock(&async->lock);
+			asyncParse(async, ctx, slot, paths[slot->index], done, user);
+			finished++;
+			pthread_mutex_lock(&async->lock);
+			slot->state = SLOT_FREE;
+			pthread_cond_broadcast(&async->taken);
+		}
+		pthread_mutex_unlock(&async->lock);
+		for (int i = 0; i < started; i++) pthread_join(ids[i], NULL);
+	}
+	pthread_cond_destroy(&async->ready);
+	pthread_cond_destroy(&async->taken);
+	pthread_mutex_destroy(&async->lock);
+	exifFree(threads);
+	exifFree(ids);
+	return finished;
+}
+#endif
+
+GLOBAL(size_t)
+exifAsyncParseFiles(j_exif_async async, j_exif_ptr ctx, const char* const* paths, size_t numPaths,
+		exif_async_done done, void* user) {
+	size_t finished = 0;
+	async->first = 0;
+#ifdef USE_IO_URING
+	if (numPaths > 0 && async->ringReady && !async->ringFailed)
+		finished = asyncRing(async, ctx, paths, numPaths, done, user);
+#endif
+#ifdef USE_THREADS
+	// the threads also take over the files a failed ring didn't get to
+	if (finished < numPaths && !async->slotsLost) {
+		async->first = finished;
+		size_t n = asyncThreads(async, ctx, paths + finished, numPaths - finished, done, user);
+		if (n != (size_t)-1) finished += n;
+	}
+#endif
+	for (; finished < numPaths; finished++) {
+		int result = exifParseFile(ctx, paths[finished]);
+		async->bytesRead += exifBytesRead_r(ctx);
+		done(ctx, finished, result, user);
+	}
+	return finished;
+}
@@ -0,0 +1,296 @@
+#include <stdio.h>
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdexif.h"
+#include "jdexifint.h"
+
+// This file implements column batches.  The fields of each row are read
+// with a field set, as exifExtract_r does for a struct of the caller's, and
+// then turned into the value of each column: the date is parsed into
+// seconds, the GPS degrees, minutes and seconds are combined with their
+// reference into signed degrees, and so on.  The columns are plain arrays
+// that grow like the entries of the writer, so a batch can be handed on
+// without touching the rows again.
+
+// the fields read for a row, for any of the columns
+struct batch_row {
+	char date[20];
+	int dateCount;
+	char offset[7];
+	int offsetCount;
+	double lat[3];
+	int latCount;
+	char latRef[2];
+	int latRefCount;
+	double lon[3];
+	int lonCount;
+	char lonRef[2];
+	int lonRefCount;
+	double exposure;
+	int exposureCount;
+	uint32_t iso;
+	int isoCount;
+	uint32_t isoSpeed;
+	int isoSpeedCount;
+	uint32_t orientation;
+	int orientationCount;
+};
+
+// the fields each column needs
+static const struct {
+	int column;
+	struct exif_field field;
+} batchFields[] = {
+	{ EXIF_COLUMN_TIMESTAMP, { EXIF_IFD_KEY(EXIF_IFD_EXIF, EXIFDateTimeOriginal), TIFF_TYPE_ASCII, 20,
+		offsetof(struct batch_row, date), offsetof(struct batch_row, dateCount) } },
+	{ EXIF_COLUMN_TIMESTAMP, { EXIF_IFD_KEY(EXIF_IFD_EXIF, EXIFOffsetTimeOriginal), TIFF_TYPE_ASCII, 7,
+		offsetof(struct batch_row, offset), offsetof(struct batch_row, offsetCount) } },
+	{ EXIF_COLUMN_LATITUDE, { EXIF_IFD_KEY(EXIF_IFD_GPS, GPSLatitude), TIFF_TYPE_RATIONAL, 3,
+		offsetof(struct batch_row, lat), offsetof(struct batch_row, latCount) } },
+	{ EXIF_COLUMN_LATITUDE, { EXIF_IFD_KEY(EXIF_IFD_GPS, GPSLatitudeRef), TIFF_TYPE_ASCII, 2,
+		offsetof(struct batch_row, latRef), offsetof(struct batch_row, latRefCount) } },
+	{ EXIF_COLUMN_LONGITUDE, { EXIF_IFD_KEY(EXIF_IFD_GPS, GPSLongitude), TIFF_TYPE_RATIONAL, 3,
+		offsetof(struct batch_row, lon), offsetof(struct batch_row, lonCount) } },
+	{ EXIF_COLUMN_LONGITUDE, { EXIF_IFD_KEY(EXIF_IFD_GPS, GPSLongitudeRef), TIFF_TYPE_ASCII, 2,
+		offsetof(struct batch_row, lonRef), offsetof(struct batch_row, lonRefCount) } },
+	{ EXIF_COLUMN_EXPOSURE, { EXIF_IFD_KEY(EXIF_IFD_EXIF, EXIFExposureTime), TIFF_TYPE_RATIONAL, 1,
+		offsetof(struct batch_row, exposure), offsetof(struct batch_row, exposureCount) } },
+	{ EXIF_COLUMN_ISO, { EXIF_IFD_KEY(EXIF_IFD_EXIF, EXIFPhotographicSensitivity), TIFF_TYPE_SHORT, 1,
+		offsetof(struct batch_row, iso), offsetof(struct batch_row, isoCount) } },
+	{ EXIF_COLUMN_ISO, { EXIF_IFD_KEY(EXIF_IFD_EXIF, EXIFISOSpeed), TIFF_TYPE_LONG, 1,
+		offsetof(struct batch_row, isoSpeed), offsetof(struct batch_row, isoSpeedCount) } },
+	{ EXIF_COLUMN_ORIENTATION, { EXIF_IFD_KEY(EXIF_IFD_0, TIFFOrientation), TIFF_TYPE_SHORT, 1,
+		offsetof(struct batch_row, orientation), offsetof(struct batch_row, orientationCount) } },
+};
+
+#define NUM_BATCH_FIELDS (sizeof(batchFields) / sizeof(batchFields[0]))
+
+// the size of an element of each column
+static const size_t columnSize[EXIF_COLUMN_COUNT] = {
+	sizeof(int64_t), sizeof(double), sizeof(double), sizeof(double), sizeof(uint32_t), sizeof(uint8_t)
+};
+
+// columnData returns where the array of column is kept in cols.
+static void**
+columnData(j_exif_columns cols, int column) {
+	switch (column) {
+	case EXIF_COLUMN_TIMESTAMP: return (void**)&cols->timestamp;
+	case EXIF_COLUMN_LATITUDE: return (void**)&cols->latitude;
+	case EXIF_COLUMN_LONGITUDE: return (void**)&cols->longitude;
+	case EXIF_COLUMN_EXPOSURE: return (void**)&cols->exposure;
+	case EXIF_COLUMN_ISO: return (void**)&cols->iso;
+	default: return (void**)&cols->orientation;
+	}
+}
+
+// columnsReserve makes room for rows rows in every column of cols, or
+// returns FALSE if out of memory.  The new bits of the bitmaps are clear.
+static boolean
+columnsReserve(j_exif_columns cols, size_t rows) {
+	if (rows <= cols->capacity) return TRUE;
+	size_t capacity = cols->capacity > 0 ? 2 * cols->capacity : 64;
+	if (capacity < rows) capacity = rows;
+	void* data[EXIF_COLUMN_COUNT];
+	uint8_t* valid[EXIF_COLUMN_COUNT];
+	boolean ok = TRUE;
+	for (int c = 0; c < EXIF_COLUMN_COUNT; c++) {
+		data[c] = NULL;
+		valid[c] = NULL;
+		if (!(cols->columns & EXIF_COLUMN_BIT(c))) continue;
+		data[c] = exifAlloc(capacity * columnSize[c]);
+		valid[c] = (uint8_t*)exifAlloc((capacity + 7) / 8);
+		if (data[c] == NULL || valid[c] == NULL) ok = FALSE;
+	}
+	for (int c = 0; c < EXIF_COLUMN_COUNT; c++) {
+		if (!(cols->columns & EXIF_COLUMN_BIT(c))) continue;
+		if (!ok) {
+			exifFree(data[c]);
+			exifFree(valid[c]);
+			continue;
+		}
+		void** old = columnData(cols, c);
+		memset(valid[c], 0, (capacity + 7) / 8);
+		if (cols->rows > 0) {
+			memcpy(data[c], *old, cols->rows * columnSize[c]);
+			memcpy(valid[c], cols->valid[c], (cols->rows + 7) / 8);
+		}
+		exifFree(*old);
+		exifFree(cols->valid[c]);
+		*old = data[c];
+		cols->valid[c] = valid[c];
+	}
+	if (ok) cols->capacity = capacity;
+	return ok;
+}
+
+// digits returns the number n digits long at s, or -1 if they aren't all digits.
+static int
+digits(const char* s, int n) {
+	int v = 0;
+	for (int i = 0; i < n; i++) {
+		if (s[i] < '0' || s[i] > '9') return -1;
+		v = v * 10 + (s[i] - '0');
+	}
+	return v;
+}
+
+// daysFromCivil returns the number of days from 1970-01-01 to a date of the
+// proleptic Gregorian calendar.
+static int64_t
+daysFromCivil(int year, int month, int day) {
+	year -= month <= 2;
+	int64_t era = (year >= 0 ? year : year - 399) / 400;
+	int64_t yearOfEra = year - era * 400;
+	int64_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	return era * 146097 + dayOfEra - 719468;
+}
+
+// parseDate turns "YYYY:MM:DD HH:MM:SS" into seconds since 1970, or returns
+// FALSE if date isn't a valid date in that form.  Cameras that don't know
+// the date write blanks or zeros, which are not valid.
+static boolean
+parseDate(const char* date, int64_t* seconds) {
+	static const int monthDays[12] = { 31,29,31,30,31,30,31,31,30,31,30,31 };
+	if (date[4] != ':' || date[7] != ':' || date[10] != ' ' || date[13] != ':' || date[16] != ':') return FALSE;
+	int year = digits(date, 4), month = digits(date + 5, 2), day = digits(date + 8, 2);
+	int hour = digits(date + 11, 2), minute = digits(date + 14, 2), second = digits(date + 17, 2);
+	if (year < 0 || month < 1 || month > 12 || day < 1 || day > monthDays[month - 1]) return FALSE;
+	if (month == 2 && day == 29 && (year % 4 != 0 || (year % 100 == 0 && year % 400 != 0))) return FALSE;
+	if (hour < 0 || hour > 23 || minute < 0 || minute > 59 || second < 0 || second > 60) return FALSE;
+	*seconds = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+	return TRUE;
+}
+
+// parseOffset turns "+HH:MM" or "-HH:MM" into seconds east of UTC, or
+// returns FALSE if offset isn't in that form.
+static boolean
+parseOffset(const char* offset, int64_t* seconds) {
+	if ((offset[0] != '+' && offset[0] != '-') || offset[3] != ':') return FALSE;
+	int hour = digits(offset + 1, 2), minute = digits(offset + 4, 2);
+	if (hour < 0 || hour > 14 || minute < 0 || minute > 59) return FALSE;
+	*seconds = (hour * 3600 + minute * 60) * (offset[0] == '-' ? -1 : 1);
+	return TRUE;
+}
+
+// degrees turns GPS degrees, minutes and seconds into signed decimal degrees,
+// or returns FALSE if the reference is neither of positive or negative or
+// the position is out of range.
+static boolean
+degrees(const double* dms, const char* ref, char positive, char negative, double limit, double* value) {
+	if (ref[0] != positive && ref[0] != negative) return FALSE;
+	double d = dms[0] + dms[1] / 60.0 + dms[2] / 3600.0;
+	if (!(d >= 0 && d <= limit)) return FALSE;
+	*value = ref[0] == negative ? -d : d;
+	return TRUE;
+}
+
+GLOBAL(j_exif_columns)
+exifColumnsCreate(unsigned int columns, size_t capacity) {
+	struct exif_field fields[NUM_BATCH_FIELDS];
+	uint32_t tags[NUM_BATCH_FIELDS];
+	int numFields = 0;
+	if (columns == 0 || (columns >> EXIF_COLUMN_COUNT) != 0) return NULL;
+	j_exif_columns cols = (j_exif_columns)exifAlloc(sizeof(struct exif_columns));
+	if (cols == NULL) return NULL;
+	memset(cols, 0, sizeof(struct exif_columns));
+	cols->columns = columns;
+	for (size_t i = 0; i < NUM_BATCH_FIELDS; i++) {
+		if (!(columns & EXIF_COLUMN_BIT(batchFields[i].column))) continue;
+		fields[numFields] = batchFields[i].field;
+		tags[numFields] = batchFields[i].field.tag;
+		numFields++;
+	}
+	cols->fields = exifFieldsCreate(fields, numFields);
+	cols->interest = exifInterestCreate(tags, numFields);
+	if (cols->fields == NULL || cols->interest == NULL || !columnsReserve(cols, capacity)) {
+		exifColumnsDestroy(cols);
+		return NULL;
+	}
+	return cols;
+}
+
+GLOBAL(void)
+exifColumnsDestroy(j_exif_columns cols) {
+	if (cols == NULL) return;
+	for (int c = 0; c < EXIF_COLUMN_COUNT; c++) {
+		exifFree(*columnData(cols, c));
+		exifFree(cols->valid[c]);
+	}
+	exifFieldsDestroy(cols->fields);
+	exifInterestDestroy(cols->interest);
+	exifFree(cols);
+}
+
+GLOBAL(void)
+exifColumnsClear(j_exif_columns cols) {
+	for (int c = 0; c < EXIF_COLUMN_COUNT; c++) {
+		if (cols->valid[c] != NULL) memset(cols->valid[c], 0, (cols->rows + 7) / 8);
+	}
+	cols->rows = 0;
+}
+
+GLOBAL(boolean)
+exifColumnsAppend_r(j_exif_ptr ctx, j_exif_columns cols) {
+	struct batch_row r;
+	if (!columnsReserve(cols, cols->rows + 1)) return FALSE;
+	memset(&r, 0, sizeof(r));
+	exifExtract_r(ctx, cols->fields, &r);
+
+	size_t row = cols->rows++;
+	uint8_t bit = (uint8_t)(1 << (row % 8));
+	unsigned int columns = cols->columns;
+	if (columns & EXIF_COLUMN_BIT(EXIF_COLUMN_TIMESTAMP)) {
+		int64_t seconds = 0, offset;
+		if (r.dateCount > 0 && parseDate(r.date, &seconds)) {
+			if (r.offsetCount > 0 && parseOffset(r.offset, &offset)) seconds -= offset;
+			cols->valid[EXIF_COLUMN_TIMESTAMP][row / 8] |= bit;
+		} else seconds = 0;
+		cols->timestamp[row] = seconds;
+	}
+	if (columns & EXIF_COLUMN_BIT(EXIF_COLUMN_LATITUDE)) {
+		double lat = 0;
+		if (r.latCount == 3 && r.latRefCount > 0 && degrees(r.lat, r.latRef, 'N', 'S', 90, &lat))
+			cols->valid[EXIF_COLUMN_LATITUDE][row / 8] |= bit;
+		cols->latitude[row] = lat;
+	}
+	if (columns & EXIF_COLUMN_BIT(EXIF_COLUMN_LONGITUDE)) {
+		double lon = 0;
+		if (r.lonCount == 3 && r.lonRefCount > 0 && degrees(r.lon, r.lonRef, 'E', 'W', 180, &lon))
+			cols->valid[EXIF_COLUMN_LONGITUDE][row / 8] |= bit;
+		cols->longitude[row] = lon;
+	}
+	if (columns & EXIF_COLUMN_BIT(EXIF_COLUMN_EXPOSURE)) {
+		boolean found = r.exposureCount == 1 && r.exposure > 0;
+		if (found) cols->valid[EXIF_COLUMN_EXPOSURE][row / 8] |= bit;
+		cols->exposure[row] = found ? r.exposure : 0;
+	}
+	if (columns & EXIF_COLUMN_BIT(EXIF_COLUMN_ISO)) {
+		// 65535 means the sensitivity didn't fit in a SHORT; ISOSpeed has it then
+		uint32_t iso = r.isoCount == 1 ? r.iso : 0;
+		if ((iso == 0 || iso == 65535) && r.isoSpeedCount == 1 && r.isoSpeed != 0) iso = r.isoSpeed;
+		if (iso != 0) cols->valid[EXIF_COLUMN_ISO][row / 8] |= bit;
+		cols->iso[row] = iso;
+	}
+	if (columns & EXIF_COLUMN_BIT(EXIF_COLUMN_ORIENTATION)) {
+		boolean found = r.orientationCount == 1 && r.orientation >= 1 && r.orientation <= 8;
+		if (found) cols->valid[EXIF_COLUMN_ORIENTATION][row / 8] |= bit;
+		cols->orientation[row] = found ? (uint8_t)r.orientation : 0;
+	}
+	return TRUE;
+}
+
+GLOBAL(size_t)
+exifColumnsParseFiles_r(j_exif_ptr ctx, j_exif_columns cols, const char* const* paths, size_t numPaths) {
+	// only keep the tags of the columns, unless the caller chose the tags
+	boolean ownInterest = !exifHasInterest_r(ctx);
+	size_t i;
+	if (!columnsReserve(cols, cols->rows + numPaths)) return 0;
+	if (ownInterest) exifSetInterest_r(ctx, cols->interest);
+	for (i = 0; i < numPaths; i++) {
+		exifParseFile(ctx, paths[i]);
+		if (!exifColumnsAppend_r(ctx, cols)) break;
+	}
+	if (ownInterest) exifSetInterest_r(ctx, NULL);
+	return i;
+}
@@ -0,0 +1,561 @@
+#include <stdio.h>
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdexif.h"
+#include "jdexifint.h"
+
+// This file implements the metadata cache.  The tags of every file parsed
+// through the cache are stored in a cache file, keyed by the path, size,
+// modification time and inode of the file.  When the file hasn't changed
+// since, its tags are read back from the cache file without opening it.
+//
+// The cache file is a header followed by records, one per parsed file.  A
+// record holds the key, the entries of the tag map and the APP1 segment they
+// point into, so a hit only copies the segment into the context.  Records
+// are only ever appended, under an exclusive flock, with one write each, and
+// a later record for a path replaces the earlier ones.  Readers don't lock:
+// they map the file and index the records in a hash table by path, and look
+// for records appended by others when a lookup misses.  A record is checked
+// against its checksum when it is used, so one that is still being written
+// or was cut short by a crash reads as a miss.  Compaction writes the newest
+// record of each path to a new file and renames it over the old one; open
+// caches notice the rename and switch to the new file.
+// Records are in the byte order of the machine that wrote them.  The header
+// gives the version of the format and the size of the structs the records
+// embed; a writer that finds a cache file it can't read replaces it with an
+// empty one, the same way.
+
+#if defined(__unix__) || defined(__APPLE__)
+#define USE_CACHE
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#endif
+
+#ifdef __APPLE__
+#define MTIME_NS(st)  ((int64_t)(st).st_mtimespec.tv_sec * 1000000000 + (st).st_mtimespec.tv_nsec)
+#else
+#define MTIME_NS(st)  ((int64_t)(st).st_mtim.tv_sec * 1000000000 + (st).st_mtim.tv_nsec)
+#endif
+
+#define CACHE_MAGIC "EXIFCAC1"
+#define CACHE_BYTE_ORDER 0x01020304
+#define CACHE_VERSION 2  // raise when the records change in any other way
+
+struct cache_header {
+	char magic[8];
+	uint32_t byteOrder;  // CACHE_BYTE_ORDER as written by the machine
+	uint32_t recordSize; // sizeof(struct cache_record)
+	uint32_t version;    // CACHE_VERSION
+	uint32_t entrySize;  // sizeof(struct tagentry)
+};
+
+// A cache_record is followed by the path and its terminating 0, padded to 8
+// bytes, numEntries struct tagentry and the segment, padded to 8 bytes.
+struct cache_record {
+	uint32_t size;          // bytes of the record, a multiple of 8
+	uint32_t checksum;      // of the bytes after this field
+	uint64_t fileSize;      // the key of the file
+	int64_t mtime;          // in nanoseconds
+	uint64_t inode;
+	uint32_t pathLength;    // without the terminating 0
+	int32_t result;         // what exifParseFile returned
+	uint32_t numEntries;
+	int32_t segmentLength;
+	uint32_t bigEndian;
+	uint32_t reserved;
+};
+
+#define ALIGN8(n)  (((n) + 7) & ~(size_t)7)
+
+// a slot of the index, offset is 0 for an empty slot
+struct cache_slot {
+	uint32_t hash;
+	uint64_t offset;
+};
+
+struct exif_cache {
+	char* path;
+	int fd;
+	boolean writable;
+	const uint8_t* map;     // the cache file, mapped read only
+	size_t mapSize;
+	size_t scanned;         // the records before this offset are indexed
+	boolean cutShort;       // the record at scanned is incomplete
+	struct cache_slot* slots;
+	uint32_t mask;
+	uint32_t used;
+	long hits;
+	long misses;
+};
+
+#ifdef USE_CACHE
+
+static uint32_t
+hashPath(const char* path) {
+	uint32_t h = 0x811C9DC5u;
+	while (*path) h = (h ^ (uint8_t)*path++) * 0x01000193u;
+	return h;
+}
+
+// recordChecksum sums the record 8 bytes at a time, as it is much longer
+// than its header and has to be checked on every hit.
+static uint32_t
+recordChecksum(const struct cache_record* rec) {
+	const uint8_t* p = (const uint8_t*)rec + 8;
+	size_t n = (rec->size - 8) / 8;
+	uint64_t h = 0xCBF29CE484222325ull;
+	for (size_t i = 0; i < n; i++) {
+		uint64_t word;
+		memcpy(&word, p + 8 * i, 8);
+		h = (h ^ word) * 0x100000001B3ull;
+		h ^= h >> 29;
+	}
+	return (uint32_t)(h ^ (h >> 32));
+}
+
+static const char*
+recordPath(const struct cache_record* rec) {
+	return (const char*)(rec + 1);
+}
+
+static const struct tagentry*
+recordEntries(const struct cache_record* rec) {
+	return (const struct tagentry*)((const uint8_t*)(rec + 1) + ALIGN8(rec->pathLength + 1));
+}
+
+static const uint8_t*
+recordSegment(const struct cache_record* rec) {
+	return (const uint8_t*)(recordEntries(rec) + rec->numEntries);
+}
+
+// recordAt returns the record at offset, or NULL if there is no complete
+// record there.
+static const struct cache_record*
+recordAt(j_exif_cache cache, size_t offset) {
+	if (offset > cache->mapSize || cache->mapSize - offset < sizeof(struct cache_record)) return NULL;
+	const struct cache_record* rec = (const struct cache_record*)(cache->map + offset);
+	if (rec->size < sizeof(struct cache_record) || (rec->size & 7) != 0 ||
+		rec->size > cache->mapSize - offset) return NULL;
+	size_t room = rec->size - sizeof(struct cache_record);
+	if (rec->pathLength >= room || ALIGN8(rec->pathLength + 1) > room) return NULL;
+	room -= ALIGN8(rec->pathLength + 1);
+	if (rec->numEntries > room / sizeof(struct tagentry) || rec->segmentLength < 0) return NULL;
+	room -= rec->numEntries * sizeof(struct tagentry);
+	if ((size_t)rec->segmentLength > room || recordPath(rec)[rec->pathLength] != 0) return NULL;
+	return rec;
+}
+
+// indexFind returns the offset of the newest record for path, or 0.
+static size_t
+indexFind(j_exif_cache cache, const char* path, uint32_t hash) {
+	if (cache->slots == NULL) return 0;
+	for (uint32_t slot = hash & cache->mask; cache->slots[slot].offset != 0; slot = (slot + 1) & cache->mask) {
+		if (cache->slots[slot].hash != hash) continue;
+		const struct cache_record* rec = (const struct cache_record*)(cache->map + cache->slots[slot].offset);
+		if (strcmp(recordPath(rec), path) == 0) return (size_t)cache->slots[slot].offset;
+	}
+	return 0;
+}
+
+// indexAdd indexes the record at offset, replacing an older one for the
+// same path.
+static boolean
+indexAdd(j_exif_cache cache, size_t offset) {
+	const struct cache_record* rec = (const struct cache_record*)(cache->map + offset);
+	uint32_t hash = hashPath(recordPath(rec));
+	if (2 * (cache->used + 1) > cache->mask + 1 || cache->slots == NULL) {
+		uint32_t size = cache->slots == NULL ? 1024 : 2 * (cache->mask + 1);
+		struct cache_slot* slots = (struct cache_slot*)exifAlloc(size * sizeof(struct cache_slot));
+		if (slots == NULL) return FALSE;
+		memset(slots, 0, size * sizeof(struct cache_slot));
+		for (uint32_t i = 0; cache->slots != NULL && i <= cache->mask; i++) {
+			if (cache->slots[i].offset == 0) continue;
+			uint32_t slot = cache->slots[i].hash & (size - 1);
+			while (slots[slot].offset != 0) slot = (slot + 1) & (size - 1);
+			slots[slot] = cache->slots[i];
+		}
+		exifFree(cache->slots);
+		cache->slots = slots;
+		cache->mask = size - 1;
+	}
+	uint32_t slot = hash & cache->mask;
+	for (; cache->slots[slot].offset != 0; slot = (slot + 1) & cache->mask) {
+		if (cache->slots[slot].hash != hash) continue;
+		const struct cache_record* old = (const struct cache_record*)(cache->map + cache->slots[slot].offset);
+		if (strcmp(recordPath(old), recordPath(rec)) == 0) break;
+	}
+	if (cache->slots[slot].offset == 0) cache->used++;
+	cache->slots[slot].hash = hash;
+	cache->slots[slot].offset = offset;
+	return TRUE;
+}
+
+// indexReset drops the index, so that the records are indexed again from
+// the start of the file.
+static void
+indexReset(j_exif_cache cache) {
+	exifFree(cache->slots);
+	cache->slots = NULL;
+	cache->mask = 0;
+	cache->used = 0;
+	cache->scanned = 0;
+	cache->cutShort = FALSE;
+}
+
+static void
+cacheUnmap(j_exif_cache cache) {
+	if (cache->map != NULL) munmap((void*)cache->map, cache->mapSize);
+	cache->map = NULL;
+	cache->mapSize = 0;
+}
+
+static void
+headerInit(struct cache_header* header) {
+	memset(header, 0, sizeof(struct cache_header));
+	memcpy(header->magic, CACHE_MAGIC, 8);
+	header->byteOrder = CACHE_BYTE_ORDER;
+	header->recordSize = sizeof(struct cache_record);
+	header->version = CACHE_VERSION;
+	header->entrySize = sizeof(struct tagentry);
+}
+
+// headerMatches tells if a cache file with this header was written in the
+// format of this build.  The header of a cache file from before the version
+// field reads with the size of its first record as the version.
+static boolean
+headerMatches(const struct cache_header* header) {
+	struct cache_header expected;
+	headerInit(&expected);
+	return memcmp(header, &expected, sizeof(struct cache_header)) == 0;
+}
+
+// cacheMap maps the whole cache file again if its size has changed and
+// indexes the new records.  Returns FALSE if the file is not a cache file.
+static boolean
+cacheMap(j_exif_cache cache) {
+	struct stat st;
+	if (fstat(cache->fd, &st) != 0) return FALSE;
+	if ((size_t)st.st_size != cache->mapSize) {
+		// a writer only cuts off a record left by a crash, which is past the
+		// records indexed; if the file is shorter than that the index is
+		// of no use
+		cacheUnmap(cache);
+		if ((size_t)st.st_size < cache->scanned) indexReset(cache);
+		if (st.st_size > 0) {
+			void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, cache->fd, 0);
+			if (map == MAP_FAILED) {
+				indexReset(cache);
+				return FALSE;
+			}
+			cache->map = (const uint8_t*)map;
+			cache->mapSize = (size_t)st.st_size;
+		}
+	}
+	if (cache->scanned == 0) {
+		// a new cache file may not have its header yet
+		if (cache->mapSize < sizeof(struct cache_header)) return cache->mapSize == 0;
+		if (!headerMatches((const struct cache_header*)cache->map)) return FALSE;
+		cache->scanned = sizeof(struct cache_header);
+	}
+	// a failed indexAdd leaves the rest to be indexed on a later call
+	for (;;) {
+		const struct cache_record* rec = recordAt(cache, cache->scanned);
+		cache->cutShort = rec == NULL && cache->scanned < cache->mapSize;
+		if (rec == NULL || !indexAdd(cache, cache->scanned)) break;
+		cache->scanned += rec->size;
+	}
+	return TRUE;
+}
+
+static void
+cacheDetach(j_exif_cache cache) {
+	cacheUnmap(cache);
+	if (cache->fd >= 0) close(cache->fd);
+	indexReset(cache);
+	cache->fd = -1;
+}
+
+// cacheReplaced tells if the cache file has been renamed over, by a
+// compaction or a rebuild, since it was opened.
+static boolean
+cacheReplaced(j_exif_cache cache) {
+	struct stat opened, current;
+	if (fstat(cache->fd, &opened) != 0 || stat(cache->path, &current) != 0) return FALSE;
+	return opened.st_ino != current.st_ino || opened.st_dev != current.st_dev;
+}
+
+// cacheRebuild replaces the cache file, which is in another format, with
+// one that has only a header, and makes it the cache's file.  It is renamed
+// over the old one, as by a compaction, so that the caches open on the old
+// file switch to it.  The caller holds the lock of the old file, which goes
+// with it.
+static boolean
+cacheRebuild(j_exif_cache cache, const struct cache_header* header) {
+	size_t tmpLength = strlen(cache->path) + 5;
+	char* tmpPath = (char*)exifAlloc(tmpLength);
+	int fd = -1;
+	boolean ok = tmpPath != NULL;
+	if (ok) {
+		snprintf(tmpPath, tmpLength, "%s.tmp", cache->path);
+		ok = (fd = open(tmpPath, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644)) >= 0;
+	}
+	if (ok) ok = write(fd, header, sizeof(struct cache_header)) == (ssize_t)sizeof(struct cache_header);
+	if (ok) ok = fsync(fd) == 0;
+	if (ok) ok = rename(tmpPath, cache->path) == 0;
+	if (ok) {
+		close(cache->fd);
+		cache->fd = fd;
+	} else {
+		if (fd >= 0) close(fd);
+		if (tmpPath != NULL) unlink(tmpPath);
+	}
+	exifFree(tmpPath);
+	return ok;
+}
+
+// cacheAttach opens the cache file and indexes its records.  A writable
+// cache file is created, with its header, if it doesn't exist, and made
+// again if it is a cache file of another format.  A file that is not a
+// cache file is not touched.
+static boolean
+cacheAttach(j_exif_cache cache) {
+	for (int attempt = 0; attempt < 8; attempt++) {
+		cache->fd = open(cache->path, cache->writable ? O_RDWR | O_CREAT | O_APPEND : O_RDONLY, 0644);
+		if (cache->fd < 0) return FALSE;
+		if (!cache->writable) return cacheMap(cache);
+		struct stat st;
+		struct cache_header header, found;
+		boolean ok = TRUE;
+		headerInit(&header);
+		flock(cache->fd, LOCK_EX);
+		// another writer may have made the file again while this one waited
+		if (cacheReplaced(cache)) {
+			flock(cache->fd, LOCK_UN);
+			close(cache->fd);
+			cache->fd = -1;
+			continue;
+		}
+		memset(&found, 0, sizeof(found));
+		if (fstat(cache->fd, &st) == 0 && st.st_size == 0)
+			ok = write(cache->fd, &header, sizeof(header)) == (ssize_t)sizeof(header);
+		else if (pread(cache->fd, &found, sizeof(found), 0) < 8 || memcmp(found.magic, CACHE_MAGIC, 8) != 0)
+			ok = FALSE;  // not a cache file, which is left alone
+		else if (!headerMatches(&found))
+			ok = cacheRebuild(cache, &header);
+		flock(cache->fd, LOCK_UN);
+		return ok && cacheMap(cache);
+	}
+	return FALSE;
+}
+
+// cacheRefresh picks up the records appended to the cache file since it was
+// last looked at, or switches to the file that replaced it.
+static void
+cacheRefresh(j_exif_cache cache) {
+	if (cache->fd >= 0 && !cacheReplaced(cache)) {
+		cacheMap(cache);
+		return;
+	}
+	cacheDetach(cache);
+	cacheAttach(cache);
+}
+
+// cacheLock takes the write lock of the current cache file and indexes all
+// its records.
+static boolean
+cacheLock(j_exif_cache cache) {
+	for (int attempt = 0; attempt < 8; attempt++) {
+		if (cache->fd < 0 && !cacheAttach(cache)) return FALSE;
+		if (flock(cache->fd, LOCK_EX) != 0) return FALSE;
+		if (!cacheReplaced(cache)) {
+			if (cacheMap(cache) && cache->scanned != 0) return TRUE;
+			break;
+		}
+		flock(cache->fd, LOCK_UN);
+		cacheDetach(cache);
+	}
+	if (cache->fd >= 0) flock(cache->fd, LOCK_UN);
+	return FALSE;
+}
+
+// keyMatches tells if rec was made from the file st describes.
+static boolean
+keyMatches(const struct cache_record* rec, const struct stat* st) {
+	return rec->fileSize == (uint64_t)st->st_size && rec->mtime == MTIME_NS(*st) &&
+		rec->inode == (uint64_t)st->st_ino;
+}
+
+// cacheStore appends a record with the tags of ctx for the file at path.
+static void
+cacheStore(j_exif_cache cache, j_exif_ptr ctx, const char* path, const struct stat* st, int result) {
+	const struct tagentry* entries;
+	const uint8_t* data;
+	int32_t length;
+	boolean bigEndian;
+
+	// a context that skips tags doesn't have them all to store
+	if (exifHasInterest_r(ctx)) return;
+	uint32_t numEntries = exifTagData_r(ctx, &entries, &data, &length, &bigEndian);
+	size_t pathLength = strlen(path);
+	if (data == NULL) length = 0;
+	size_t size = sizeof(struct cache_record) + ALIGN8(pathLength + 1) +
+		numEntries * sizeof(struct tagentry) + ALIGN8((size_t)length);
+	if (size > 0x7FFFFFFF) return;
+	struct cache_record* rec = (struct cache_record*)exifAlloc(size);
+	if (rec == NULL) return;
+	memset(rec, 0, size);
+	rec->size = (uint32_t)size;
+	rec->fileSize = (uint64_t)st->st_size;
+	rec->mtime = MTIME_NS(*st);
+	rec->inode = (uint64_t)st->st_ino;
+	rec->pathLength = (uint32_t)pathLength;
+	rec->result = result;
+	rec->numEntries = numEntries;
+	rec->segmentLength = length;
+	rec->bigEndian = bigEndian;
+	memcpy((char*)(rec + 1), path, pathLength);
+	struct tagentry* out = (struct tagentry*)recordEntries(rec);
+	if (numEntries > 0) memcpy(out, entries, numEntries * sizeof(struct tagentry));
+	if (length > 0) memcpy((uint8_t*)(out + numEntries), data, length);
+	rec->checksum = recordChecksum(rec);
+
+	if (cacheLock(cache)) {
+		// a writer that died in the middle of a record leaves it at the end
+		if (cache->cutShort && ftruncate(cache->fd, (off_t)cache->scanned) == 0)
+			cacheMap(cache);
+		if (cache->scanned == cache->mapSize && write(cache->fd, rec, size) == (ssize_t)size)
+			cacheMap(cache);
+		flock(cache->fd, LOCK_UN);
+	}
+	exifFree(rec);
+}
+
+GLOBAL(j_exif_cache)
+exifCacheOpen(const char* path, boolean writable) {
+	j_exif_cache cache = (j_exif_cache)exifAlloc(sizeof(struct exif_cache));
+	if (cache == NULL) return NULL;
+	memset(cache, 0, sizeof(struct exif_cache));
+	cache->fd = -1;
+	cache->writable = writable;
+	cache->path = (char*)exifAlloc(strlen(path) + 1);
+	if (cache->path != NULL) strcpy(cache->path, path);
+	if (cache->path == NULL || !cacheAttach(cache)) {
+		exifCacheClose(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+GLOBAL(void)
+exifCacheClose(j_exif_cache cache) {
+	if (cache == NULL) return;
+	cacheDetach(cache);
+	exifFree(cache->path);
+	exifFree(cache);
+}
+
+GLOBAL(int)
+exifParseFileCached(j_exif_ptr ctx, j_exif_cache cache, const char* path) {
+	struct stat st;
+	// the cache only has the tags, not the other metadata
+	if (cache == NULL || exifCapturesMetadata_r(ctx)) return exifParseFile(ctx, path);
+	if (stat(path, &st) != 0) {
+		tagmapFree_r(ctx);
+		return -1;
+	}
+	uint32_t hash = hashPath(path);
+	size_t offset = indexFind(cache, path, hash);
+	if (offset == 0 || !keyMatches((const struct cache_record*)(cache->map + offset), &st)) {
+		// another process may have parsed it since
+		cacheRefresh(cache);
+		offset = indexFind(cache, path, hash);
+	}
+	if (offset != 0) {
+		const struct cache_record* rec = (const struct cache_record*)(cache->map + offset);
+		if (keyMatches(rec, &st) && rec->checksum == recordChecksum(rec) &&
+			exifLoadTags_r(ctx, recordEntries(rec), rec->numEntries, rec->segmentLength > 0 ? recordSegment(rec) : NULL,
+				rec->segmentLength, (boolean)rec->bigEndian)) {
+			cache->hits++;
+			return rec->result;
+		}
+	}
+	cache->misses++;
+	int result = exifParseFile(ctx, path);
+	// -1 may be a file that can't be read for now, so it is not stored
+	if (cache->writable && result >= 0) cacheStore(cache, ctx, path, &st, result);
+	return result;
+}
+
+GLOBAL(boolean)
+exifCacheCompact(j_exif_cache cache, boolean dropStale) {
+	if (cache == NULL || !cache->writable || !cacheLock(cache)) return FALSE;
+	size_t tmpLength = strlen(cache->path) + 5;
+	char* tmpPath = (char*)exifAlloc(tmpLength);
+	// the records that couldn't be indexed would be lost
+	boolean ok = tmpPath != NULL && (cache->scanned == cache->mapSize || cache->cutShort);
+	FILE* fp = NULL;
+	if (ok) {
+		// open it with the mode cacheAttach gives a new cache file, not 0666
+		snprintf(tmpPath, tmpLength, "%s.tmp", cache->path);
+		int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd >= 0 && (fp = fdopen(fd, "wb")) == NULL) close(fd);
+		ok = fp != NULL && fwrite(cache->map, sizeof(struct cache_header), 1, fp) == 1;
+	}
+	for (size_t offset = sizeof(struct cache_header); ok && offset < cache->scanned; ) {
+		const struct cache_record* rec = (const struct cache_record*)(cache->map + offset);
+		const char* path = recordPath(rec);
+		struct stat st;
+		boolean keep = indexFind(cache, path, hashPath(path)) == offset && rec->checksum == recordChecksum(rec);
+		if (keep && dropStale) keep = stat(path, &st) == 0 && keyMatches(rec, &st);
+		if (keep) ok = fwrite(rec, rec->size, 1, fp) == 1;
+		offset += rec->size;
+	}
+	if (fp != NULL) {
+		ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0 && ok;
+		fclose(fp);
+	}
+	if (ok) ok = rename(tmpPath, cache->path) == 0;
+	else if (tmpPath != NULL) unlink(tmpPath);
+	exifFree(tmpPath);
+	// the lock goes with the old file, which other writers now find replaced
+	flock(cache->fd, LOCK_UN);
+	if (ok) {
+		cacheDetach(cache);
+		ok = cacheAttach(cache);
+	}
+	return ok;
+}
+
+#else
+
+// without mmap and flock there is no cache, and files are always parsed
+
+GLOBAL(j_exif_cache)
+exifCacheOpen(const char* path, boolean writable) {
+	return NULL;
+}
+
+GLOBAL(void)
+exifCacheClose(j_exif_cache cache) {
+}
+
+GLOBAL(int)
+exifParseFileCached(j_exif_ptr ctx, j_exif_cache cache, const char* path) {
+	return exifParseFile(ctx, path);
+}
+
+GLOBAL(boolean)
+exifCacheCompact(j_exif_cache cache, boolean dropStale) {
+	return FALSE;
+}
+
+#endif
+
+GLOBAL(void)
+exifCacheStats(j_exif_cache cache, long* hits, long* misses) {
+	*hits = cache != NULL ? cache->hits : 0;
+	*misses = cache != NULL ? cache->misses : 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+// jdexifint.h declares what the modules of the EXIF extension share with
+// each other.  Applications only need jdexif.h.
+
+#ifndef JDEXIFINT_H
+#define JDEXIFINT_H
+
+#include "jdexif.h"
+
+// A tagentry describes one tag of the tag map.  Its value is at offset in
+// the APP1 segment the tags were parsed from.
+struct tagentry {
+	uint16_t tag; // tiff, exif or gps tag
+	uint16_t type; // data type as defined in the TIFF file spec
+	uint32_t count; // count of the data of type above
+	uint32_t offset; // offset of said data in the APP1 segment.
+	uint32_t ifd; // the IFD the entry came from, one of the EXIF_IFD_ values
+};
+
+// exifTagData_r decodes any entries that lazy parsing has left and returns
+// the entries of ctx and the segment they point into.  *data is NULL if ctx
+// has no EXIF data.
+uint32_t exifTagData_r(j_exif_ptr ctx, const struct tagentry** entries,
+	const uint8_t** data, int32_t* length, boolean* bigEndian);
+
+// exifHasInterest_r tells if ctx only keeps the tags of an interest set,
+// so that its tags are not all the tags of the file.
+boolean exifHasInterest_r(j_exif_ptr ctx);
+
+// exifCapturesMetadata_r tells if ctx keeps metadata segments other than
+// EXIF, which are not stored with the tags.
+boolean exifCapturesMetadata_r(j_exif_ptr ctx);
+
+// exifLoadTags_r replaces the tags of ctx with numEntries entries of a
+// segment of length bytes, as exifTagData_r returned them.  The segment is
+// copied into ctx.  Entries whose value isn't inside the segment, or that
+// are not in the interest set of ctx, are dropped.  Returns FALSE if out of
+// memory.
+boolean exifLoadTags_r(j_exif_ptr ctx, const struct tagentry* entries, uint32_t numEntries,
+	const uint8_t* data, int32_t length, boolean bigEndian);
+
+// exifAlloc and exifFree allocate memory with the functions given to
+// exifSetAllocator.
+void* exifAlloc(size_t size);
+void exifFree(void* p);
+
+#endif // !JDEXIFINT_H
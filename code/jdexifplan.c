@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdexif.h"
+#include "jdexifint.h"
+
+// This file implements decode planning.  The orientation of the EXIF data
+// and the size in the SOF marker are both known after jpeg_read_header, so
+// the scale of the IDCT can be chosen for the image as it will be shown,
+// and the decoded rows can be put straight into their rotated place.  No
+// pixel is then decoded at full size or rotated in a second pass.
+
+#if JPEG_LIB_VERSION >= 70 || defined(LIBJPEG_TURBO_VERSION)
+#define SCALE_EIGHTHS  /* the IDCT scales by any of 1/8 to 8/8 */
+#endif
+
+// orientationFlags gives the transpose and flips that turn the decoded image
+// upright, for each of the orientations 1 to 8.  The transpose is done
+// first.
+#define PLAN_TRANSPOSE 1
+#define PLAN_FLIP_X 2
+#define PLAN_FLIP_Y 4
+static const uint8_t orientationFlags[9] = {
+	0,                                          // not valid, taken as 1
+	0,                                          // 1 upright already
+	PLAN_FLIP_X,                                // 2 mirror
+	PLAN_FLIP_X | PLAN_FLIP_Y,                  // 3 turn 180
+	PLAN_FLIP_Y,                                // 4 mirror top to bottom
+	PLAN_TRANSPOSE,                             // 5 transpose
+	PLAN_TRANSPOSE | PLAN_FLIP_X,               // 6 turn 90 clockwise
+	PLAN_TRANSPOSE | PLAN_FLIP_X | PLAN_FLIP_Y, // 7 transverse
+	PLAN_TRANSPOSE | PLAN_FLIP_Y,               // 8 turn 90 counterclockwise
+};
+
+// fitSize returns the size of an image of width by height shrunk to fit in
+// maxWidth by maxHeight, keeping its aspect ratio.  A bound of 0 is none.
+LOCAL(void)
+fitSize(JDIMENSION width, JDIMENSION height, JDIMENSION maxWidth, JDIMENSION maxHeight,
+		JDIMENSION* fitWidth, JDIMENSION* fitHeight) {
+	*fitWidth = width;
+	*fitHeight = height;
+	if (maxWidth != 0 && *fitWidth > maxWidth) {
+		*fitHeight = (JDIMENSION)(((uint64_t)height * maxWidth + width - 1) / width);
+		*fitWidth = maxWidth;
+	}
+	if (maxHeight != 0 && *fitHeight > maxHeight) {
+		*fitWidth = (JDIMENSION)(((uint64_t)width * maxHeight + height - 1) / height);
+		*fitHeight = maxHeight;
+	}
+}
+
+GLOBAL(boolean)
+exifPlanDecode_r(j_exif_ptr ctx, j_decompress_ptr cinfo, JDIMENSION maxWidth, JDIMENSION maxHeight,
+		struct exif_decode_plan* plan) {
+	uint32_t orientation = 1;
+	if (exifUIntData_r(ctx, EXIF_IFD_KEY(EXIF_IFD_0, TIFFOrientation), &orientation) != 1 ||
+			orientation < 1 || orientation > 8)
+		orientation = 1;
+	boolean transpose = (orientationFlags[orientation] & PLAN_TRANSPOSE) != 0;
+	if (cinfo->image_width == 0 || cinfo->image_height == 0) return FALSE;
+
+	// the size the image is needed at, as shown
+	JDIMENSION shownWidth = transpose ? cinfo->image_height : cinfo->image_width;
+	JDIMENSION shownHeight = transpose ? cinfo->image_width : cinfo->image_height;
+	JDIMENSION needWidth, needHeight;
+	fitSize(shownWidth, shownHeight, maxWidth, maxHeight, &needWidth, &needHeight);
+
+	// take the smallest scale that still gives at least that many pixels
+#ifdef SCALE_EIGHTHS
+	static const unsigned int scaleNum[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	static const unsigned int scaleDenom[] = { 8, 8, 8, 8, 8, 8, 8, 8 };
+#else
+	static const unsigned int scaleNum[] = { 1, 1, 1, 1 };
+	static const unsigned int scaleDenom[] = { 8, 4, 2, 1 };
+#endif
+	int numScales = (int)(sizeof(scaleNum) / sizeof(scaleNum[0]));
+	for (int i = 0; i < numScales; i++) {
+		cinfo->scale_num = scaleNum[i];
+		cinfo->scale_denom = scaleDenom[i];
+		jpeg_calc_output_dimensions(cinfo);
+		JDIMENSION width = transpose ? cinfo->output_height : cinfo->output_width;
+		JDIMENSION height = transpose ? cinfo->output_width : cinfo->output_height;
+		if (width >= needWidth && height >= needHeight) break;
+	}
+
+	plan->orientation = (int)orientation;
+	plan->transpose = transpose;
+	plan->flipX = (orientationFlags[orientation] & PLAN_FLIP_X) != 0;
+	plan->flipY = (orientationFlags[orientation] & PLAN_FLIP_Y) != 0;
+	plan->scaleNum = cinfo->scale_num;
+	plan->scaleDenom = cinfo->scale_denom;
+	plan->decodedWidth = cinfo->output_width;
+	plan->decodedHeight = cinfo->output_height;
+	plan->width = transpose ? cinfo->output_height : cinfo->output_width;
+	plan->height = transpose ? cinfo->output_width : cinfo->output_height;
+	plan->components = cinfo->output_components;
+	fitSize(plan->width, plan->height, maxWidth, maxHeight, &plan->fitWidth, &plan->fitHeight);
+	return TRUE;
+}
+
+GLOBAL(void)
+exifPlanWriteRows(const struct exif_decode_plan* plan, JSAMPARRAY rows, JDIMENSION firstRow,
+		JDIMENSION numRows, JSAMPLE* dest, size_t destStride) {
+	int components = plan->components;
+	JDIMENSION width = plan->decodedWidth;
+	// where the decoded pixel (x, y) goes is dest + y * yStep + x * xStep,
+	// starting from the place of pixel (0, 0)
+	ptrdiff_t pixel = (ptrdiff_t)components;
+	ptrdiff_t line = (ptrdiff_t)destStride;
+	ptrdiff_t xStep = plan->transpose ? line : pixel;
+	ptrdiff_t yStep = plan->transpose ? pixel : line;
+	JSAMPLE* origin = dest;
+	if (plan->flipX) {
+		origin += (ptrdiff_t)(plan->width - 1) * pixel;
+		if (plan->transpose) yStep = -yStep;
+		else xStep = -xStep;
+	}
+	if (plan->flipY) {
+		origin += (ptrdiff_t)(plan->height - 1) * line;
+		if (plan->transpose) xStep = -xStep;
+		else yStep = -yStep;
+	}
+
+	for (JDIMENSION r = 0; r < numRows; r++) {
+		const JSAMPLE* src = rows[r];
+		JSAMPLE* out = origin + (ptrdiff_t)(firstRow + r) * yStep;
+		if (xStep == pixel) {
+			memcpy(out, src, (size_t)width * components);
+			continue;
+		}
+		for (JDIMENSION x = 0; x < width; x++) {
+			for (int c = 0; c < components; c++) out[c] = src[c];
+			src += components;
+			out += xStep;
+		}
+	}
+}
@@ -0,0 +1,637 @@
+#include <stdio.h>
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdexif.h"
+#include "jdexifint.h"
+
+// This file implements the EXIF writer.  An editor starts with a copy of the
+// tags of a context, takes changes to them, and serializes them into a new
+// APP1 segment.  exifRewriteFile puts that segment into a JPEG file in place
+// of the old one and copies every other marker segment and the compressed
+// image byte for byte, so the image is never decoded.
+//
+// The tags keep the byte order of the segment they were read from, and the
+// values of unchanged tags are copied as they are.  The pointers that tie
+// the IFDs together, the Interoperability IFD and the thumbnail are laid out
+// again, as they are offsets into the segment.  Everything else that holds
+// offsets, mainly the MakerNote of some cameras, is copied as an opaque
+// value and may point to the wrong place once the tags before it change size.
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define USE_FSYNC  /* flush the rewritten file to disk before renaming it */
+#define USE_MKSTEMP  /* give the temporary file a unique name and the input's mode */
+#endif
+
+// The Interoperability IFD hangs off the Exif IFD.  It is kept by the
+// editor but can't be changed through it.
+#define EDIT_IFD_INTEROP (EXIF_IFD_1 + 1)
+#define EDIT_IFD_COUNT (EDIT_IFD_INTEROP + 1)
+
+#define TAG_EXIF_POINTER 0x8769
+#define TAG_GPS_POINTER 0x8825
+#define TAG_INTEROP_POINTER 0xA005
+#define TAG_STRIP_OFFSETS 0x0111
+
+// the largest payload of a marker segment, whose length field counts itself
+#define MAX_SEGMENT 65533
+
+// the sizes of the TIFF types, as in jdexif.c
+static const int typeSize[] = { 0,1,1,2,4,8,0,1,0,4,8 };
+
+// An edit_entry is one tag.  value points to count values in the byte order
+// of the editor, either in the copy of the segment or in owned.
+struct edit_entry {
+	uint16_t tag;
+	uint16_t type;
+	uint32_t count;
+	uint32_t ifd;
+	const uint8_t* value;
+	uint8_t* owned;  // memory of a value that was set, or NULL
+};
+
+struct exif_editor {
+	struct edit_entry* entries;
+	uint32_t numEntries;
+	uint32_t maxEntries;
+	uint8_t* segment;        // copy of the segment the tags came from
+	int32_t length;
+	boolean bigEndian;
+	const uint8_t* thumbnail;  // inside segment, or NULL
+	uint32_t thumbnailSize;
+};
+
+static uint32_t
+get16(j_exif_edit ed, const uint8_t* p) {
+	if (ed->bigEndian) return ((uint32_t)p[0] << 8) + p[1];
+	return ((uint32_t)p[1] << 8) + p[0];
+}
+
+static uint32_t
+get32(j_exif_edit ed, const uint8_t* p) {
+	if (ed->bigEndian)
+		return ((uint32_t)p[0] << 24) + ((uint32_t)p[1] << 16) + ((uint32_t)p[2] << 8) + p[3];
+	return ((uint32_t)p[3] << 24) + ((uint32_t)p[2] << 16) + ((uint32_t)p[1] << 8) + p[0];
+}
+
+static void
+put16(j_exif_edit ed, uint8_t* p, uint32_t v) {
+	if (ed->bigEndian) {
+		p[0] = (uint8_t)(v >> 8);
+		p[1] = (uint8_t)v;
+	} else {
+		p[0] = (uint8_t)v;
+		p[1] = (uint8_t)(v >> 8);
+	}
+}
+
+static void
+put32(j_exif_edit ed, uint8_t* p, uint32_t v) {
+	if (ed->bigEndian) {
+		p[0] = (uint8_t)(v >> 24);
+		p[1] = (uint8_t)(v >> 16);
+		p[2] = (uint8_t)(v >> 8);
+		p[3] = (uint8_t)v;
+	} else {
+		p[0] = (uint8_t)v;
+		p[1] = (uint8_t)(v >> 8);
+		p[2] = (uint8_t)(v >> 16);
+		p[3] = (uint8_t)(v >> 24);
+	}
+}
+
+// editFind returns the entry of tag in ifd, or NULL.
+static struct edit_entry*
+editFind(j_exif_edit ed, uint32_t ifd, uint32_t tag) {
+	for (uint32_t i = 0; i < ed->numEntries; i++) {
+		struct edit_entry* e = &ed->entries[i];
+		if (e->ifd == ifd && e->tag == tag) return e;
+	}
+	return NULL;
+}
+
+// editAppend adds an empty entry for tag in ifd, or returns NULL if out of
+// memory.
+static struct edit_entry*
+editAppend(j_exif_edit ed, uint32_t ifd, uint32_t tag) {
+	struct edit_entry* e;
+	if (ed->numEntries == ed->maxEntries) {
+		uint32_t maxEntries = ed->maxEntries > 0 ? 2 * ed->maxEntries : 64;
+		struct edit_entry* entries = (struct edit_entry*)exifAlloc(maxEntries * sizeof(struct edit_entry));
+		if (entries == NULL) return NULL;
+		if (ed->numEntries > 0) memcpy(entries, ed->entries, ed->numEntries * sizeof(struct edit_entry));
+		exifFree(ed->entries);
+		ed->entries = entries;
+		ed->maxEntries = maxEntries;
+	}
+	e = &ed->entries[ed->numEntries++];
+	memset(e, 0, sizeof(struct edit_entry));
+	e->tag = (uint16_t)tag;
+	e->ifd = ifd;
+	return e;
+}
+
+// editAdd returns the entry of tag in ifd, adding an empty one if there is
+// none, or NULL if out of memory.
+static struct edit_entry*
+editAdd(j_exif_edit ed, uint32_t ifd, uint32_t tag) {
+	struct edit_entry* e = editFind(ed, ifd, tag);
+	return e != NULL ? e : editAppend(ed, ifd, tag);
+}
+
+// editRemove takes the entry out of the editor.
+static void
+editRemove(j_exif_edit ed, struct edit_entry* e) {
+	exifFree(e->owned);
+	*e = ed->entries[--ed->numEntries];
+}
+
+// loadInterop adds the entries of the Interoperability IFD that the entry
+// at pointer, in the copy of the segment, points to.
+static boolean
+loadInterop(j_exif_edit ed, const struct edit_entry* pointer) {
+	if (pointer->type != TIFF_TYPE_LONG || pointer->count != 1) return TRUE;
+	uint32_t offset = get32(ed, pointer->value) + 6;  // tiff header starts at data[6]
+	if (offset < 14 || offset > (uint32_t)ed->length - 2) return TRUE;
+	uint32_t count = get16(ed, ed->segment + offset);
+	offset += 2;
+	for (uint32_t i = 0; i < count && offset <= (uint32_t)ed->length - 12; i++, offset += 12) {
+		const uint8_t* raw = ed->segment + offset;
+		uint32_t type = get16(ed, raw + 2);
+		uint32_t n = get32(ed, raw + 4);
+		if (type >= sizeof(typeSize) / sizeof(typeSize[0]) || typeSize[type] == 0) continue;
+		if (n > (uint32_t)ed->length) continue;
+		const uint8_t* value = raw + 8;
+		if (n * typeSize[type] > 4) {
+			uint32_t at = get32(ed, raw + 8) + 6;
+			if (at > (uint32_t)ed->length || n * typeSize[type] > (uint32_t)ed->length - at) continue;
+			value = ed->segment + at;
+		}
+		struct edit_entry* e = editAdd(ed, EDIT_IFD_INTEROP, get16(ed, raw));
+		if (e == NULL) return FALSE;
+		e->type = (uint16_t)type;
+		e->count = n;
+		e->value = value;
+	}
+	return TRUE;
+}
+
+// exifEditCreate copies the tags of ctx, which may be NULL, into a new editor.
+GLOBAL(j_exif_edit)
+exifEditCreate(j_exif_ptr ctx) {
+	const struct tagentry* entries = NULL;
+	const uint8_t* data = NULL;
+	int32_t length = 0;
+	boolean bigEndian = FALSE;
+	uint32_t numEntries = 0;
+	const uint8_t* thumbnail = NULL;
+	size_t thumbnailSize = 0;
+
+	// a context that skipped tags would lose them
+	if (ctx != NULL && exifHasInterest_r(ctx)) return NULL;
+	if (ctx != NULL) {
+		numEntries = exifTagData_r(ctx, &entries, &data, &length, &bigEndian);
+		if (!exifThumbnail_r(ctx, &thumbnail, &thumbnailSize)) thumbnail = NULL;
+	}
+	j_exif_edit ed = (j_exif_edit)exifAlloc(sizeof(struct exif_editor));
+	if (ed == NULL) return NULL;
+	memset(ed, 0, sizeof(struct exif_editor));
+	ed->bigEndian = bigEndian;
+	if (data == NULL || length <= 0) return ed;
+
+	ed->segment = (uint8_t*)exifAlloc((size_t)length);
+	if (ed->segment == NULL) {
+		exifEditDestroy(ed);
+		return NULL;
+	}
+	memcpy(ed->segment, data, (size_t)length);
+	ed->length = length;
+	boolean strips = FALSE;
+	for (uint32_t i = 0; i < numEntries; i++) {
+		const struct tagentry* t = &entries[i];
+		if (t->ifd < EXIF_IFD_0 || t->ifd > EXIF_IFD_1) continue;
+		// the pointers are written again by exifEditSerialize
+		if (t->ifd == EXIF_IFD_0 && (t->tag == TAG_EXIF_POINTER || t->tag == TAG_GPS_POINTER)) continue;
+		if (t->ifd == EXIF_IFD_1 && (t->tag == TIFFJPEGInterchangeFormat ||
+			t->tag == TIFFJPEGInterchangeFormatLength)) continue;
+		if (t->ifd == EXIF_IFD_1 && t->tag == TAG_STRIP_OFFSETS) strips = TRUE;
+		struct edit_entry* e = editAppend(ed, t->ifd, t->tag);
+		if (e == NULL) {
+			exifEditDestroy(ed);
+			return NULL;
+		}
+		e->type = t->type;
+		e->count = t->count;
+		e->value = ed->segment + t->offset;
+	}
+	struct edit_entry* pointer = editFind(ed, EXIF_IFD_EXIF, TAG_INTEROP_POINTER);
+	if (pointer != NULL) {
+		struct edit_entry link = *pointer;
+		editRemove(ed, pointer);
+		if (!loadInterop(ed, &link)) {
+			exifEditDestroy(ed);
+			return NULL;
+		}
+	}
+	// an uncompressed thumbnail is made of strips that are not kept, so
+	// IFD1 would describe an image that isn't there
+	if (strips) exifEditDeleteIFD(ed, EXIF_IFD_1);
+	else if (thumbnail != NULL) {
+		ed->thumbnail = ed->segment + (thumbnail - data);
+		ed->thumbnailSize = (uint32_t)thumbnailSize;
+	}
+	return ed;
+}
+
+GLOBAL(void)
+exifEditDestroy(j_exif_edit ed) {
+	if (ed == NULL) return;
+	for (uint32_t i = 0; i < ed->numEntries; i++) exifFree(ed->entries[i].owned);
+	exifFree(ed->entries);
+	exifFree(ed->segment);
+	exifFree(ed);
+}
+
+// editIFD returns the IFD of the entry an accessor would find for tag, or
+// the IFD the key gives.  Plain tags that are not there go in IFD0.
+static uint32_t
+editIFD(j_exif_edit ed, uint32_t tag) {
+	static const uint32_t searchOrder[] = { EXIF_IFD_0, EXIF_IFD_EXIF, EXIF_IFD_GPS, EXIF_IFD_1 };
+	if ((tag >> 16) != EXIF_IFD_ANY) return tag >> 16;
+	for (unsigned int i = 0; i < sizeof(searchOrder) / sizeof(searchOrder[0]); i++)
+		if (editFind(ed, searchOrder[i], tag) != NULL) return searchOrder[i];
+	return EXIF_IFD_0;
+}
+
+GLOBAL(boolean)
+exifEditSet(j_exif_edit ed, uint32_t tag, uint16_t type, uint32_t count, const void* values) {
+	uint32_t ifd = editIFD(ed, tag);
+	tag &= 0xFFFF;
+	if (ifd < EXIF_IFD_0 || ifd > EXIF_IFD_1) return FALSE;
+	if (type >= sizeof(typeSize) / sizeof(typeSize[0]) || typeSize[type] == 0) return FALSE;
+	if (count == 0 || count > (uint32_t)(MAX_SEGMENT / typeSize[type])) return FALSE;
+	// the layout tags are the editor's to write
+	if (ifd == EXIF_IFD_0 && (tag == TAG_EXIF_POINTER || tag == TAG_GPS_POINTER)) return FALSE;
+	if (ifd == EXIF_IFD_EXIF && tag == TAG_INTEROP_POINTER) return FALSE;
+	if (ifd == EXIF_IFD_1 && (tag == TIFFJPEGInterchangeFormat ||
+		tag == TIFFJPEGInterchangeFormatLength || tag == TAG_STRIP_OFFSETS)) return FALSE;
+
+	uint8_t* value = (uint8_t*)exifAlloc((size_t)count * typeSize[type]);
+	if (value == NULL) return FALSE;
+	// store the values in the byte order of the segment
+	uint8_t* out = value;
+	for (uint32_t i = 0; i < count; i++) {
+		switch (type) {
+		case TIFF_TYPE_BYTE:
+		case TIFF_TYPE_ASCII:
+		case TIFF_TYPE_UNDEFINED:
+			*out = ((const uint8_t*)values)[i];
+			break;
+		case TIFF_TYPE_SHORT:
+			put16(ed, out, ((const uint16_t*)values)[i]);
+			break;
+		case TIFF_TYPE_LONG:
+		case TIFF_TYPE_SLONG:
+			put32(ed, out, ((const uint32_t*)values)[i]);
+			break;
+		case TIFF_TYPE_RATIONAL:
+		case TIFF_TYPE_SRATIONAL:
+			put32(ed, out, ((const uint32_t*)values)[2 * i]);
+			put32(ed, out + 4, ((const uint32_t*)values)[2 * i + 1]);
+			break;
+		}
+		out += typeSize[type];
+	}
+	struct edit_entry* e = editAdd(ed, ifd, tag);
+	if (e == NULL) {
+		exifFree(value);
+		return FALSE;
+	}
+	exifFree(e->owned);
+	e->type = type;
+	e->count = count;
+	e->value = value;
+	e->owned = value;
+	return TRUE;
+}
+
+GLOBAL(boolean)
+exifEditDelete(j_exif_edit ed, uint32_t tag) {
+	uint32_t ifd = editIFD(ed, tag);
+	tag &= 0xFFFF;
+	if (ifd == EXIF_IFD_1 && (tag == TIFFJPEGInterchangeFormat || tag == TIFFJPEGInterchangeFormatLength)) {
+		boolean found = ed->thumbnail != NULL;
+		ed->thumbnail = NULL;
+		return found;
+	}
+	struct edit_entry* e = editFind(ed, ifd, tag);
+	if (e == NULL) return FALSE;
+	editRemove(ed, e);
+	return TRUE;
+}
+
+GLOBAL(void)
+exifEditDeleteIFD(j_exif_edit ed, uint32_t ifd) {
+	for (uint32_t i = ed->numEntries; i-- > 0; )
+		if (ed->entries[i].ifd == ifd || (ifd == EXIF_IFD_EXIF && ed->entries[i].ifd == EDIT_IFD_INTEROP))
+			editRemove(ed, &ed->entries[i]);
+	if (ifd == EXIF_IFD_1) ed->thumbnail = NULL;
+}
+
+// An ifd_layout describes one IFD of the new segment.  Its entries are in
+// tag order and are followed by the pointer entries it needs.
+struct ifd_layout {
+	struct edit_entry** entries;
+	uint32_t numEntries;
+	uint32_t numPointers;  // SubIFD pointers, or the thumbnail tags of IFD1
+	uint32_t offset;       // of the IFD from the TIFF header
+	uint32_t size;         // of the IFD and the values that don't fit in it
+};
+
+static int
+compareTags(const void* a, const void* b) {
+	const struct edit_entry* x = *(const struct edit_entry* const*)a;
+	const struct edit_entry* y = *(const struct edit_entry* const*)b;
+	return (int)x->tag - (int)y->tag;
+}
+
+#define ALIGN2(n)  (((n) + 1) & ~(uint32_t)1)
+
+// writeEntry writes a 12 byte IFD entry at p.  A value that doesn't fit in
+// the entry goes to *valueOffset in tiff, which is moved past it.
+static void
+writeEntry(j_exif_edit ed, uint8_t* tiff, uint8_t* p, uint32_t tag, uint32_t type, uint32_t count,
+		const uint8_t* value, uint32_t* valueOffset) {
+	uint32_t numBytes = count * typeSize[type];
+	put16(ed, p, tag);
+	put16(ed, p + 2, type);
+	put32(ed, p + 4, count);
+	memset(p + 8, 0, 4);
+	if (numBytes <= 4) {
+		memcpy(p + 8, value, numBytes);
+	} else {
+		put32(ed, p + 8, *valueOffset);
+		memcpy(tiff + *valueOffset, value, numBytes);
+		if (numBytes & 1) tiff[*valueOffset + numBytes] = 0;
+		*valueOffset += ALIGN2(numBytes);
+	}
+}
+
+// writePointer writes an entry with a LONG value, such as a SubIFD pointer.
+static void
+writePointer(j_exif_edit ed, uint8_t* tiff, uint8_t* p, uint32_t tag, uint32_t value) {
+	uint8_t bytes[4];
+	put32(ed, bytes, value);
+	writeEntry(ed, tiff, p, tag, TIFF_TYPE_LONG, 1, bytes, NULL);
+}
+
+// exifEditSerialize lays the IFDs out in the order IFD0, Exif, Interop, GPS
+// and IFD1, each followed by its values, and the thumbnail last.  An IFD is
+// written if it has at least one entry, as TIFF allows; jdexif.c reads such
+// IFDs back in both eager and lazy mode.
+GLOBAL(size_t)
+exifEditSerialize(j_exif_edit ed, uint8_t* buffer, size_t size) {
+	struct ifd_layout ifds[EDIT_IFD_COUNT];
+	static const uint32_t order[] = { EXIF_IFD_0, EXIF_IFD_EXIF, EDIT_IFD_INTEROP, EXIF_IFD_GPS, EXIF_IFD_1 };
+	struct edit_entry** sorted;
+	size_t total = 0;
+
+	if (ed->numEntries == 0 && ed->thumbnail == NULL) return 0;
+	sorted = (struct edit_entry**)exifAlloc(ed->numEntries * sizeof(struct edit_entry*) + 1);
+	if (sorted == NULL) return 0;
+	memset(ifds, 0, sizeof(ifds));
+	struct edit_entry** next = sorted;
+	for (unsigned int i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+		struct ifd_layout* ifd = &ifds[order[i]];
+		ifd->entries = next;
+		for (uint32_t n = 0; n < ed->numEntries; n++)
+			if (ed->entries[n].ifd == order[i]) ifd->entries[ifd->numEntries++] = &ed->entries[n];
+		qsort(ifd->entries, ifd->numEntries, sizeof(struct edit_entry*), compareTags);
+		next += ifd->numEntries;
+	}
+	ifds[EXIF_IFD_EXIF].numPointers = ifds[EDIT_IFD_INTEROP].numEntries > 0;
+	ifds[EXIF_IFD_0].numPointers = (ifds[EXIF_IFD_EXIF].numEntries + ifds[EXIF_IFD_EXIF].numPointers > 0) +
+		(ifds[EXIF_IFD_GPS].numEntries > 0);
+	ifds[EXIF_IFD_1].numPointers = ed->thumbnail != NULL ? 2 : 0;
+
+	// lay the IFDs out after the 8 byte TIFF header
+	uint32_t offset = 8;
+	for (unsigned int i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+		struct ifd_layout* ifd = &ifds[order[i]];
+		uint32_t n = ifd->numEntries + ifd->numPointers;
+		if (n == 0 && order[i] != EXIF_IFD_0) continue;
+		ifd->offset = offset;
+		ifd->size = 2 + 12 * n + 4;
+		for (uint32_t k = 0; k < ifd->numEntries; k++) {
+			uint32_t numBytes = ifd->entries[k]->count * typeSize[ifd->entries[k]->type];
+			if (numBytes > 4) ifd->size += ALIGN2(numBytes);
+		}
+		offset += ifd->size;
+	}
+	uint32_t thumbnailOffset = offset;
+	if (ed->thumbnail != NULL) offset += ed->thumbnailSize;
+	total = 6 + (size_t)offset;
+	if (total > MAX_SEGMENT) total = 0;
+	if (total == 0 || buffer == NULL || size < total) {
+		exifFree(sorted);
+		return total;
+	}
+
+	memcpy(buffer, "Exif\0\0", 6);
+	uint8_t* tiff = buffer + 6;
+	memcpy(tiff, ed->bigEndian ? "MM\0*" : "II*\0", 4);
+	put32(ed, tiff + 4, 8);
+	for (unsigned int i = 0; i < sizeof(order) / sizeof(order[0]); i++) {
+		uint32_t number = order[i];
+		struct ifd_layout* ifd = &ifds[number];
+		uint32_t n = ifd->numEntries + ifd->numPointers;
+		if (ifd->size == 0) continue;
+		uint8_t* p = tiff + ifd->offset;
+		uint32_t valueOffset = ifd->offset + 2 + 12 * n + 4;
+		uint32_t k = 0, pointer = 0;
+		uint32_t pointerTags[2], pointerValues[2];
+
+		// the pointer entries, which must be merged in tag order
+		if (number == EXIF_IFD_0) {
+			if (ifds[EXIF_IFD_EXIF].size != 0) {
+				pointerTags[pointer] = TAG_EXIF_POINTER;
+				pointerValues[pointer++] = ifds[EXIF_IFD_EXIF].offset;
+			}
+			if (ifds[EXIF_IFD_GPS].size != 0) {
+				pointerTags[pointer] = TAG_GPS_POINTER;
+				pointerValues[pointer++] = ifds[EXIF_IFD_GPS].offset;
+			}
+		} else if (number == EXIF_IFD_EXIF && ifd->numPointers > 0) {
+			pointerTags[pointer] = TAG_INTEROP_POINTER;
+			pointerValues[pointer++] = ifds[EDIT_IFD_INTEROP].offset;
+		} else if (number == EXIF_IFD_1 && ifd->numPointers > 0) {
+			pointerTags[pointer] = TIFFJPEGInterchangeFormat;
+			pointerValues[pointer++] = thumbnailOffset;
+			pointerTags[pointer] = TIFFJPEGInterchangeFormatLength;
+			pointerValues[pointer++] = ed->thumbnailSize;
+		}
+		put16(ed, p, n);
+		p += 2;
+		uint32_t nextPointer = 0;
+		while (k < ifd->numEntries || nextPointer < pointer) {
+			if (nextPointer < pointer && (k == ifd->numEntries || pointerTags[nextPointer] < ifd->entries[k]->tag)) {
+				writePointer(ed, tiff, p, pointerTags[nextPointer], pointerValues[nextPointer]);
+				nextPointer++;
+			} else {
+				struct edit_entry* e = ifd->entries[k++];
+				writeEntry(ed, tiff, p, e->tag, e->type, e->count, e->value, &valueOffset);
+			}
+			p += 12;
+		}
+		// only IFD0 links to the next IFD, IFD1
+		put32(ed, p, number == EXIF_IFD_0 ? ifds[EXIF_IFD_1].offset : 0);
+	}
+	if (ed->thumbnail != NULL) memcpy(tiff + thumbnailOffset, ed->thumbnail, ed->thumbnailSize);
+	exifFree(sorted);
+	return total;
+}
+
+
+// This section rewrites a JPEG file with a new APP1 segment.  The markers
+// are read with stdio and everything but the old EXIF segment is copied as
+// it is read, so the cost is one pass over the file.
+
+#define COPY_BUFFER 65536
+
+#define M_SOI   0xD8
+#define M_EOI   0xD9
+#define M_SOS   0xDA
+#define M_APP0  0xE0
+#define M_APP1  0xE1
+#define M_TEM   0x01
+#define M_RST0  0xD0
+#define M_RST7  0xD7
+
+// copyBytes copies n bytes from in to out, or all that is left if n is -1.
+static boolean
+copyBytes(FILE* in, FILE* out, long n, uint8_t* buffer) {
+	while (n != 0) {
+		size_t want = n < 0 || n > COPY_BUFFER ? COPY_BUFFER : (size_t)n;
+		size_t got = fread(buffer, 1, want, in);
+		if (got > 0 && fwrite(buffer, 1, got, out) != got) return FALSE;
+		if (got < want) return n < 0 && !ferror(in);
+		if (n > 0) n -= (long)got;
+	}
+	return TRUE;
+}
+
+// writeSegment writes the APP1 marker and its payload.
+static boolean
+writeSegment(FILE* out, const uint8_t* payload, size_t size) {
+	uint8_t header[4] = { 0xFF, 0xE1, (uint8_t)((size + 2) >> 8), (uint8_t)(size + 2) };
+	return fwrite(header, 1, 4, out) == 4 && fwrite(payload, 1, size, out) == size;
+}
+
+// rewriteStream copies the JPEG file in to out with payload as its EXIF
+// segment.  The new segment goes right after SOI and any APP0 segments
+// that follow it, before other APP1 segments like XMP, as readers expect
+// EXIF there; the old EXIF segments are dropped wherever they are.  No
+// segment is written if size is 0.
+static boolean
+rewriteStream(FILE* in, FILE* out, const uint8_t* payload, size_t size, uint8_t* buffer) {
+	boolean written = size == 0;
+	int marker;
+
+	if (getc(in) != 0xFF || getc(in) != M_SOI) return FALSE;
+	if (putc(0xFF, out) == EOF || putc(M_SOI, out) == EOF) return FALSE;
+	for (;;) {
+		if (getc(in) != 0xFF) return FALSE;  // lost sync with the markers
+		do {
+			marker = getc(in);
+		} while (marker == 0xFF);  // drop any fill bytes
+		if (marker == EOF) return FALSE;
+		if (!written && marker != M_APP0) {
+			if (!writeSegment(out, payload, size)) return FALSE;
+			written = TRUE;
+		}
+		if (marker == M_TEM || (marker >= M_RST0 && marker <= M_RST7)) {
+			if (putc(0xFF, out) == EOF || putc(marker, out) == EOF) return FALSE;
+			continue;  // markers without a length
+		}
+		if (marker == M_SOS || marker == M_EOI) {
+			// the rest of the file is the compressed image, copied as it is
+			if (putc(0xFF, out) == EOF || putc(marker, out) == EOF) return FALSE;
+			return copyBytes(in, out, -1, buffer);
+		}
+		int hi = getc(in);
+		int lo = getc(in);
+		if (lo == EOF) return FALSE;
+		long length = (hi << 8) + lo - 2;
+		if (length < 0) return FALSE;
+		uint8_t header[6];
+		long headerLength = length < 6 ? length : 6;
+		if (fread(header, 1, (size_t)headerLength, in) != (size_t)headerLength) return FALSE;
+		if (marker == M_APP1 && headerLength == 6 && 0 == memcmp(header, "Exif", 5)) {
+			// the new segment is already written
+			if (fseek(in, length - 6, SEEK_CUR) != 0) return FALSE;
+			continue;
+		}
+		uint8_t markerHeader[4] = { 0xFF, (uint8_t)marker, (uint8_t)hi, (uint8_t)lo };
+		if (fwrite(markerHeader, 1, 4, out) != 4) return FALSE;
+		if (fwrite(header, 1, (size_t)headerLength, out) != (size_t)headerLength) return FALSE;
+		if (!copyBytes(in, out, length - headerLength, buffer)) return FALSE;
+	}
+}
+
+// openTemp creates the temporary file for outPath and puts its name in
+// tmpPath.  It is in the same directory, so that it can be renamed over
+// outPath, and gets the permissions of the input file in, which it keeps
+// once renamed.  Returns NULL if it can't be made.
+static FILE*
+openTemp(char* tmpPath, size_t tmpLength, const char* outPath, FILE* in) {
+#ifdef USE_MKSTEMP
+	struct stat st;
+	FILE* out = NULL;
+	snprintf(tmpPath, tmpLength, "%s.XXXXXX", outPath);
+	int fd = mkstemp(tmpPath);
+	if (fd < 0) return NULL;
+	if (fstat(fileno(in), &st) == 0 && fchmod(fd, st.st_mode & 07777) == 0) out = fdopen(fd, "wb");
+	if (out == NULL) {
+		close(fd);
+		remove(tmpPath);
+	}
+	return out;
+#else
+	(void)in;
+	snprintf(tmpPath, tmpLength, "%s.tmp", outPath);
+	return fopen(tmpPath, "wb");
+#endif
+}
+
+// exifRewriteFile writes to a temporary file next to outPath and renames it
+// over outPath once it is complete, so outPath may be inPath.
+GLOBAL(boolean)
+exifRewriteFile(j_exif_edit ed, const char* inPath, const char* outPath) {
+	size_t size = exifEditSerialize(ed, NULL, 0);
+	if (size == 0 && (ed->numEntries > 0 || ed->thumbnail != NULL)) return FALSE;  // too large
+	size_t tmpLength = strlen(outPath) + 8;
+	char* tmpPath = (char*)exifAlloc(tmpLength);
+	uint8_t* payload = (uint8_t*)exifAlloc(size + COPY_BUFFER);
+	boolean ok = tmpPath != NULL && payload != NULL;
+	FILE* in = NULL;
+	FILE* out = NULL;
+	if (ok) ok = size == 0 || exifEditSerialize(ed, payload, size) == size;
+	if (ok) ok = (in = fopen(inPath, "rb")) != NULL;
+	if (ok) ok = (out = openTemp(tmpPath, tmpLength, outPath, in)) != NULL;
+	if (ok) ok = rewriteStream(in, out, payload, size, payload + size);
+	if (out != NULL) {
+		ok = fflush(out) == 0 && ok;
+#ifdef USE_FSYNC
+		ok = ok && fsync(fileno(out)) == 0;
+#endif
+		ok = fclose(out) == 0 && ok;
+	}
+	if (in != NULL) fclose(in);
+	if (ok) ok = rename(tmpPath, outPath) == 0;
+	if (!ok && out != NULL) remove(tmpPath);
+	exifFree(tmpPath);
+	exifFree(payload);
+	return ok;
+}
@@ -0,0 +1,526 @@
+// exifextract: writes the EXIF data of many JPEG files as JSON lines or CSV.
+//
+// Build it against a libjpeg that has jdexif.c and jdexifcache.c added, for example
+//   cc -O2 -I<libjpeg> exifextract.c <libjpeg>/libjpeg.a -lpthread -o exifextract
+//
+// Usage:  exifextract [-t threads] [-f jsonl|csv] [-o stable|completed] [-l listfile] [-c cachefile] [-p] [file|dir] ...
+//
+// Directories are searched recursively for .jpg and .jpeg files, and -l reads
+// more paths, one per line, from listfile ("-" for standard input).  Each
+// thread has its own exif context and reads the files with exifParseFile, so
+// no pixels are decoded.  The files are split evenly among the threads up
+// front, and a thread that runs out of files steals the second half of the
+// files another thread has left.  With -o stable (the default) the rows are
+// written in the order the files were given; with -o completed each row is
+// written as soon as its file is done.  With -c the files are read through
+// the metadata cache in cachefile, which is created if needed, so files that
+// haven't changed since an earlier run are not opened again.  -p reads only
+// the bytes up to the end of the EXIF segment with pread
+// (EXIF_OPTION_MINIMAL_READ), for slow network and object storage.  At the
+// end the number of files, the files per second, the bytes read and the
+// bytes in the files are printed to stderr.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "jpeglib.h"
+#include "jdexif.h"
+
+// the fields written for every file
+struct photo {
+	char make[64];
+	char model[64];
+	char lens[64];
+	char date[20];
+	uint32_t orientation;
+	int orientationCount;
+	uint32_t width;
+	int widthCount;
+	uint32_t height;
+	int heightCount;
+	double exposure;
+	int exposureCount;
+	double fNumber;
+	int fNumberCount;
+	uint32_t iso;
+	int isoCount;
+	double focalLength;
+	int focalLengthCount;
+	double lat[3];
+	int latCount;
+	char latRef[2];
+	double lon[3];
+	int lonCount;
+	char lonRef[2];
+};
+
+static const struct exif_field photoFields[] = {
+	{ TIFFMake, TIFF_TYPE_ASCII, 64, offsetof(struct photo, make), EXIF_NO_COUNT },
+	{ TIFFModel, TIFF_TYPE_ASCII, 64, offsetof(struct photo, model), EXIF_NO_COUNT },
+	{ EXIFLensModel, TIFF_TYPE_ASCII, 64, offsetof(struct photo, lens), EXIF_NO_COUNT },
+	{ EXIFDateTimeOriginal, TIFF_TYPE_ASCII, 20, offsetof(struct photo, date), EXIF_NO_COUNT },
+	{ TIFFOrientation, TIFF_TYPE_SHORT, 1, offsetof(struct photo, orientation), offsetof(struct photo, orientationCount) },
+	{ EXIFPixelXDimension, TIFF_TYPE_LONG, 1, offsetof(struct photo, width), offsetof(struct photo, widthCount) },
+	{ EXIFPixelYDimension, TIFF_TYPE_LONG, 1, offsetof(struct photo, height), offsetof(struct photo, heightCount) },
+	{ EXIFExposureTime, TIFF_TYPE_RATIONAL, 1, offsetof(struct photo, exposure), offsetof(struct photo, exposureCount) },
+	{ EXIFFNumber, TIFF_TYPE_RATIONAL, 1, offsetof(struct photo, fNumber), offsetof(struct photo, fNumberCount) },
+	{ EXIFPhotographicSensitivity, TIFF_TYPE_SHORT, 1, offsetof(struct photo, iso), offsetof(struct photo, isoCount) },
+	{ EXIFFocalLength, TIFF_TYPE_RATIONAL, 1, offsetof(struct photo, focalLength), offsetof(struct photo, focalLengthCount) },
+	{ GPSLatitude, TIFF_TYPE_RATIONAL, 3, offsetof(struct photo, lat), offsetof(struct photo, latCount) },
+	{ GPSLatitudeRef, TIFF_TYPE_ASCII, 2, offsetof(struct photo, latRef), EXIF_NO_COUNT },
+	{ GPSLongitude, TIFF_TYPE_RATIONAL, 3, offsetof(struct photo, lon), offsetof(struct photo, lonCount) },
+	{ GPSLongitudeRef, TIFF_TYPE_ASCII, 2, offsetof(struct photo, lonRef), EXIF_NO_COUNT },
+};
+
+static const char* columns[] = {
+	"path", "status", "make", "model", "lens", "date_time_original", "orientation", "width", "height",
+	"exposure_time", "f_number", "iso", "focal_length", "latitude", "longitude"
+};
+
+// text is a growable string the rows are formatted into.
+struct text {
+	char* s;
+	size_t len;
+	size_t cap;
+};
+
+// a worker owns the files [first, last) that it hasn't started yet
+struct worker {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int first;
+	int last;
+	long done;
+	long withExif;
+	long cached;
+	uint64_t bytesRead;
+	uint64_t bytes;
+};
+
+static char** paths;
+static int numPaths;
+static int maxPaths;
+static struct worker* workers;
+static int numWorkers;
+static j_exif_fields fieldSet;
+static j_exif_interest interest;
+static boolean csv = FALSE;
+static boolean stable = TRUE;
+static const char* cachePath;
+static boolean minimalRead = FALSE;
+
+static pthread_mutex_t outputLock = PTHREAD_MUTEX_INITIALIZER;
+static char** pending;  // rows of finished files waiting for their turn with -o stable
+static int nextRow;
+
+static double
+now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+addPath(const char* path) {
+	if (numPaths == maxPaths) {
+		maxPaths = maxPaths ? maxPaths * 2 : 1024;
+		paths = (char**)realloc(paths, maxPaths * sizeof(char*));
+		if (paths == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	paths[numPaths] = strdup(path);
+	if (paths[numPaths] == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	numPaths++;
+}
+
+static int
+compareNames(const void* a, const void* b) {
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static boolean
+isJpegName(const char* name) {
+	const char* dot = strrchr(name, '.');
+	return dot != NULL && (strcasecmp(dot, ".jpg") == 0 || strcasecmp(dot, ".jpeg") == 0);
+}
+
+// addDirectory adds the JPEG files under dir.  The names in each directory are
+// sorted so that the order of the files doesn't depend on the file system.
+// Symbolic links to directories are not followed.
+static void
+addDirectory(const char* dir) {
+	DIR* d = opendir(dir);
+	struct dirent* entry;
+	char** names = NULL;
+	int numNames = 0, maxNames = 0;
+	if (d == NULL) {
+		fprintf(stderr, "can't read %s\n", dir);
+		return;
+	}
+	while ((entry = readdir(d)) != NULL) {
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+		if (numNames == maxNames) {
+			maxNames = maxNames ? maxNames * 2 : 64;
+			names = (char**)realloc(names, maxNames * sizeof(char*));
+			if (names == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+		}
+		names[numNames] = strdup(entry->d_name);
+		if (names[numNames] == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		numNames++;
+	}
+	closedir(d);
+	qsort(names, numNames, sizeof(char*), compareNames);
+
+	size_t dirLength = strlen(dir);
+	for (int i = 0; i < numNames; i++) {
+		char* path = (char*)malloc(dirLength + strlen(names[i]) + 2);
+		struct stat st;
+		if (path == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		sprintf(path, "%s%s%s", dir, dirLength > 0 && dir[dirLength - 1] == '/' ? "" : "/", names[i]);
+		if (lstat(path, &st) == 0) {
+			if (S_ISDIR(st.st_mode)) addDirectory(path);
+			else if (isJpegName(names[i])) addPath(path);
+		}
+		free(path);
+		free(names[i]);
+	}
+	free(names);
+}
+
+static void
+addArgument(const char* path) {
+	struct stat st;
+	if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) addDirectory(path);
+	else addPath(path);
+}
+
+static boolean
+addList(const char* listFile) {
+	FILE* f = strcmp(listFile, "-") == 0 ? stdin : fopen(listFile, "r");
+	char line[4096];
+	if (f == NULL) return FALSE;
+	while (fgets(line, sizeof(line), f) != NULL) {
+		size_t n = strcspn(line, "\r\n");
+		line[n] = 0;
+		if (n > 0) addArgument(line);
+	}
+	if (f != stdin) fclose(f);
+	return TRUE;
+}
+
+static void
+append(struct text* t, const char* format, ...) {
+	va_list args;
+	for (;;) {
+		va_start(args, format);
+		int n = vsnprintf(t->s + t->len, t->cap - t->len, format, args);
+		va_end(args);
+		if (n >= 0 && (size_t)n < t->cap - t->len) {
+			t->len += n;
+			return;
+		}
+		t->cap = t->cap * 2 + (n > 0 ? n : 0) + 256;
+		t->s = (char*)realloc(t->s, t->cap);
+		if (t->s == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+}
+
+// appendString writes a string value: a quoted and escaped JSON string, or a
+// CSV field that is quoted if it has to be.
+static void
+appendString(struct text* t, const char* s) {
+	if (csv) {
+		if (strpbrk(s, ",\"\r\n") == NULL) {
+			append(t, "%s", s);
+			return;
+		}
+		append(t, "\"");
+		for (; *s; s++) {
+			if (*s == '"') append(t, "\"\"");
+			else append(t, "%c", *s);
+		}
+		append(t, "\"");
+		return;
+	}
+	append(t, "\"");
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\') append(t, "\\%c", c);
+		else if (c < 0x20) append(t, "\\u%04x", c);
+		else append(t, "%c", c);
+	}
+	append(t, "\"");
+}
+
+// field starts the next column of a row.
+static void
+field(struct text* t, int column) {
+	if (csv) {
+		if (column > 0) append(t, ",");
+	} else {
+		append(t, "%s\"%s\":", column == 0 ? "{" : ",", columns[column]);
+	}
+}
+
+static void
+missing(struct text* t) {
+	if (!csv) append(t, "null");
+}
+
+static void
+appendText(struct text* t, int column, const char* s) {
+	field(t, column);
+	if (s[0] != 0) appendString(t, s);
+	else missing(t);
+}
+
+static void
+appendUInt(struct text* t, int column, uint32_t v, int count) {
+	field(t, column);
+	if (count > 0) append(t, "%u", v);
+	else missing(t);
+}
+
+static void
+appendDouble(struct text* t, int column, double v, int count) {
+	field(t, column);
+	if (count > 0) append(t, "%.10g", v);
+	else missing(t);
+}
+
+// degrees turns GPS degrees, minutes and seconds into signed decimal degrees.
+static double
+degrees(const double* dms, const char* ref) {
+	double d = dms[0] + dms[1] / 60.0 + dms[2] / 3600.0;
+	return ref[0] == 'S' || ref[0] == 'W' ? -d : d;
+}
+
+static void
+formatRow(struct text* t, const char* path, int status, const struct photo* p) {
+	static const struct photo none;
+	if (p == NULL) p = &none;
+	appendText(t, 0, path);
+	appendText(t, 1, status == 1 ? "ok" : status == 0 ? "no_exif" : "error");
+	appendText(t, 2, p->make);
+	appendText(t, 3, p->model);
+	appendText(t, 4, p->lens);
+	appendText(t, 5, p->date);
+	appendUInt(t, 6, p->orientation, p->orientationCount);
+	appendUInt(t, 7, p->width, p->widthCount);
+	appendUInt(t, 8, p->height, p->heightCount);
+	appendDouble(t, 9, p->exposure, p->exposureCount);
+	appendDouble(t, 10, p->fNumber, p->fNumberCount);
+	appendUInt(t, 11, p->iso, p->isoCount);
+	appendDouble(t, 12, p->focalLength, p->focalLengthCount);
+	appendDouble(t, 13, p->latCount == 3 ? degrees(p->lat, p->latRef) : 0, p->latCount == 3);
+	appendDouble(t, 14, p->lonCount == 3 ? degrees(p->lon, p->lonRef) : 0, p->lonCount == 3);
+	append(t, csv ? "\n" : "}\n");
+}
+
+// writeRow writes the row of file right away, or with -o stable once the
+// rows of all the files before it are written.
+static void
+writeRow(int file, const struct text* row) {
+	pthread_mutex_lock(&outputLock);
+	if (!stable) {
+		fwrite(row->s, 1, row->len, stdout);
+	} else {
+		pending[file] = strdup(row->s);
+		if (pending[file] == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		while (nextRow < numPaths && pending[nextRow] != NULL) {
+			fputs(pending[nextRow], stdout);
+			free(pending[nextRow]);
+			pending[nextRow++] = NULL;
+		}
+	}
+	pthread_mutex_unlock(&outputLock);
+}
+
+// takeFile gives the worker its next file.  A worker without files left
+// takes the second half of the files another worker has left.  Returns FALSE
+// when all the files have been taken.
+static boolean
+takeFile(struct worker* self, int* file) {
+	pthread_mutex_lock(&self->lock);
+	if (self->first < self->last) {
+		*file = self->first++;
+		pthread_mutex_unlock(&self->lock);
+		return TRUE;
+	}
+	pthread_mutex_unlock(&self->lock);
+
+	int me = (int)(self - workers);
+	for (int i = 1; i < numWorkers; i++) {
+		struct worker* victim = &workers[(me + i) % numWorkers];
+		pthread_mutex_lock(&victim->lock);
+		int left = victim->last - victim->first;
+		if (left > 0) {
+			int last = victim->last;
+			int mid = last - (left + 1) / 2;
+			victim->last = mid;
+			pthread_mutex_unlock(&victim->lock);
+			pthread_mutex_lock(&self->lock);
+			self->first = mid + 1;
+			self->last = last;
+			pthread_mutex_unlock(&self->lock);
+			*file = mid;
+			return TRUE;
+		}
+		pthread_mutex_unlock(&victim->lock);
+	}
+	return FALSE;
+}
+
+static void*
+workerMain(void* arg) {
+	struct worker* self = (struct worker*)arg;
+	j_exif_ptr ctx = exifCreate();
+	j_exif_cache cache = cachePath != NULL ? exifCacheOpen(cachePath, TRUE) : NULL;
+	struct text row = { NULL, 0, 0 };
+	int file;
+	long misses;
+
+	if (ctx == NULL) return NULL;
+	if (minimalRead) exifSetOptions(ctx, EXIF_OPTION_MINIMAL_READ);
+	exifSetInterest_r(ctx, interest);
+	while (takeFile(self, &file)) {
+		struct photo p;
+		struct stat st;
+		int status = exifParseFileCached(ctx, cache, paths[file]);
+		if (status == 1) {
+			exifExtract_r(ctx, fieldSet, &p);
+			self->withExif++;
+		}
+		if (stat(paths[file], &st) == 0) self->bytes += st.st_size;
+		self->bytesRead += exifBytesRead_r(ctx);
+		row.len = 0;
+		formatRow(&row, paths[file], status, status == 1 ? &p : NULL);
+		writeRow(file, &row);
+		self->done++;
+	}
+	free(row.s);
+	exifCacheStats(cache, &self->cached, &misses);
+	exifCacheClose(cache);
+	exifDestroy(ctx);
+	return NULL;
+}
+
+static int
+usage(const char* name) {
+	fprintf(stderr, "usage: %s [-t threads] [-f jsonl|csv] [-o stable|completed] [-l listfile] [-c cachefile] [-p] [file|dir] ...\n", name);
+	return 2;
+}
+
+int
+main(int argc, char** argv) {
+	int opt;
+	numWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "t:f:o:l:c:p")) != -1) {
+		if (opt == 't') numWorkers = atoi(optarg);
+		else if (opt == 'f' && strcmp(optarg, "jsonl") == 0) csv = FALSE;
+		else if (opt == 'f' && strcmp(optarg, "csv") == 0) csv = TRUE;
+		else if (opt == 'o' && strcmp(optarg, "stable") == 0) stable = TRUE;
+		else if (opt == 'o' && strcmp(optarg, "completed") == 0) stable = FALSE;
+		else if (opt == 'c') cachePath = optarg;
+		else if (opt == 'p') minimalRead = TRUE;
+		else if (opt == 'l') {
+			if (!addList(optarg)) {
+				fprintf(stderr, "can't read %s\n", optarg);
+				return 1;
+			}
+		}
+		else return usage(argv[0]);
+	}
+	for (int i = optind; i < argc; i++) addArgument(argv[i]);
+	if (numPaths == 0 || numWorkers < 1) return usage(argv[0]);
+	if (numWorkers > numPaths) numWorkers = numPaths;
+
+	fieldSet = exifFieldsCreate(photoFields, sizeof(photoFields) / sizeof(photoFields[0]));
+	// only keep the tags of the columns, unless they go to the cache which
+	// keeps all of them
+	if (cachePath == NULL) {
+		uint32_t tags[sizeof(photoFields) / sizeof(photoFields[0])];
+		for (unsigned int i = 0; i < sizeof(tags) / sizeof(tags[0]); i++) tags[i] = photoFields[i].tag;
+		interest = exifInterestCreate(tags, sizeof(tags) / sizeof(tags[0]));
+	}
+	pending = (char**)calloc(numPaths, sizeof(char*));
+	workers = (struct worker*)calloc(numWorkers, sizeof(struct worker));
+	if (fieldSet == NULL || (cachePath == NULL && interest == NULL) || pending == NULL || workers == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	if (cachePath != NULL) {
+		j_exif_cache cache = exifCacheOpen(cachePath, TRUE);
+		if (cache == NULL) {
+			fprintf(stderr, "can't open the cache %s\n", cachePath);
+			return 1;
+		}
+		exifCacheClose(cache);
+	}
+	if (csv) {
+		for (unsigned int i = 0; i < sizeof(columns) / sizeof(columns[0]); i++)
+			printf("%s%s", i > 0 ? "," : "", columns[i]);
+		printf("\n");
+	}
+
+	double start = now();
+	for (int i = 0; i < numWorkers; i++) {
+		pthread_mutex_init(&workers[i].lock, NULL);
+		workers[i].first = (int)((int64_t)numPaths * i / numWorkers);
+		workers[i].last = (int)((int64_t)numPaths * (i + 1) / numWorkers);
+	}
+	for (int i = 0; i < numWorkers; i++) pthread_create(&workers[i].thread, NULL, workerMain, &workers[i]);
+	long done = 0, withExif = 0, cached = 0;
+	uint64_t bytes = 0, bytesRead = 0;
+	for (int i = 0; i < numWorkers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		done += workers[i].done;
+		withExif += workers[i].withExif;
+		cached += workers[i].cached;
+		bytes += workers[i].bytes;
+		bytesRead += workers[i].bytesRead;
+	}
+	for (int i = 0; i < numWorkers; i++) pthread_mutex_destroy(&workers[i].lock);
+	double seconds = now() - start;
+	fflush(stdout);
+
+	fprintf(stderr, "%ld files, %ld with EXIF data, %d threads, %.2f s, %.0f files/s, %.3f MB read of %.1f MB in the files\n",
+		done, withExif, numWorkers, seconds, done / seconds, bytesRead / 1e6, bytes / 1e6);
+	if (cachePath != NULL) fprintf(stderr, "%ld files from the cache\n", cached);
+	exifFieldsDestroy(fieldSet);
+	exifInterestDestroy(interest);
+	for (int i = 0; i < numPaths; i++) free(paths[i]);
+	free(paths);
+	free(pending);
+	free(workers);
+	return done == numPaths ? 0 : 1;
+}